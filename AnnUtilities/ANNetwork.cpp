@@ -0,0 +1,90 @@
+#include "ANNetwork.h"
+#include "Layer.h"
+#include "InputData.h"
+
+namespace AnnUtilities
+{
+	ANNetwork::ANNetwork()
+	{
+	}
+
+	ANNetwork::~ANNetwork()
+	{
+		Clean();
+	}
+
+	// Builds the layers _settings describes, a network that was already built is rebuilt
+	void ANNetwork::Init()
+	{
+		Clean();
+		_inputLayer = new Layer(nullptr, _settings._inputSize, 0.0f, _settings._hiddenActicationFunction);
+		Layer* previous = _inputLayer;
+		for (int i = 0; i < _settings._numberOfHiddenLayers; ++i)
+		{
+			Layer* hidden = new Layer(previous, _settings._hiddenSize, _settings._momentum, _settings._hiddenActicationFunction);
+			previous->setNextLayer(hidden);
+			previous = hidden;
+		}
+		_outputLayer = new Layer(previous, _settings._outputSize, _settings._momentum, _settings._outputActicationFunction);
+		previous->setNextLayer(_outputLayer);
+	}
+
+	// Reads the input layer's outputs, the caller sets them
+	void ANNetwork::propagateForward()
+	{
+		for (Layer* layer = _inputLayer->_nextLayer; layer != nullptr; layer = layer->_nextLayer)
+		{
+			layer->propagateForward();
+		}
+	}
+
+	// Accumulates the gradients of the last forward pass, update applies them
+	void ANNetwork::propagateBackward(const float* const labels)
+	{
+		_outputLayer->propagateBackward(labels);
+		for (Layer* layer = _outputLayer->_prevLayer; layer != _inputLayer; layer = layer->_prevLayer)
+		{
+			layer->propagateBackward();
+		}
+	}
+
+	// One pass over inputSize samples as a single batch
+	void ANNetwork::Epoch(const InputData* const inputData, const int inputSize, const float learningRate)
+	{
+		if (inputSize <= 0)
+		{
+			return;
+		}
+		for (int i = 0; i < inputSize; ++i)
+		{
+			_inputLayer->setOutputs(inputData[i]._input);
+			propagateForward();
+			propagateBackward(inputData[i]._label);
+		}
+		for (Layer* layer = _inputLayer->_nextLayer; layer != nullptr; layer = layer->_nextLayer)
+		{
+			layer->update(learningRate, inputSize);
+		}
+	}
+
+	void ANNetwork::update(const int batchSize)
+	{
+		for (Layer* layer = _inputLayer->_nextLayer; layer != nullptr; layer = layer->_nextLayer)
+		{
+			layer->update(_settings._learningRate, batchSize);
+		}
+	}
+
+	void ANNetwork::Clean()
+	{
+		Layer* layer = _inputLayer;
+		while (layer != nullptr)
+		{
+			Layer* next = layer->_nextLayer;
+			delete layer;
+			layer = next;
+		}
+		_inputLayer = nullptr;
+		_outputLayer = nullptr;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "Functions.h"
+#include <math.h>
+
+namespace AnnUtilities
+{
+	float sigmoid(float x)
+	{
+		return 1.0f / (1.0f + expf(-x));
+	}
+
+	// The derivatives take the activated value, not the pre-activation
+	float dSigmoid(float x)
+	{
+		return x * (1.0f - x);
+	}
+
+	float relu(float x)
+	{
+		return x > 0.0f ? x : 0.0f;
+	}
+
+	float dRelu(float x)
+	{
+		return x > 0.0f ? 1.0f : 0.0f;
+	}
+
+	float leakyRelu(float x)
+	{
+		return x > 0.0f ? x : 0.01f * x;
+	}
+
+	float dLeakyRelu(float x)
+	{
+		return x > 0.0f ? 1.0f : 0.01f;
+	}
+
+	float hypTanh(float x)
+	{
+		return tanhf(x);
+	}
+
+	float dTanh(float x)
+	{
+		return 1.0f - x * x;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "Layer.h"
+#include <math.h>
+#include <stdlib.h>
+
+namespace AnnUtilities
+{
+	static float activate(ACTFUNC actfunc, float x)
+	{
+		switch (actfunc)
+		{
+		case ACTFUNC::SIGMOID: return sigmoid(x);
+		case ACTFUNC::RELU: return relu(x);
+		case ACTFUNC::LEAKY_RELU: return leakyRelu(x);
+		default: return hypTanh(x);
+		}
+	}
+
+	static float derivative(ACTFUNC actfunc, float y)
+	{
+		switch (actfunc)
+		{
+		case ACTFUNC::SIGMOID: return dSigmoid(y);
+		case ACTFUNC::RELU: return dRelu(y);
+		case ACTFUNC::LEAKY_RELU: return dLeakyRelu(y);
+		default: return dTanh(y);
+		}
+	}
+
+	// The input layer only holds outputs. The weights of other layers are row major, a row per node and a column per
+	// node of the previous layer, and start uniform in +-1/sqrt(fan-in) from rand(), so srand makes runs differ.
+	Layer::Layer(Layer* previousLayer, int layerSize, float momentum, ACTFUNC actfunc)
+		: _actfunc(actfunc), _momentum(momentum), _layerSize(layerSize), _prevLayer(previousLayer)
+	{
+		_outputs = new float[layerSize]();
+		if (_prevLayer == nullptr)
+		{
+			return;
+		}
+		int weights = layerSize * _prevLayer->_layerSize;
+		_weights = new float[weights];
+		_biases = new float[layerSize]();
+		_error = new float[layerSize]();
+		_deltaWeights = new float[weights]();
+		_deltaBiases = new float[layerSize]();
+		if (_momentum > 0.0f)
+		{
+			_weightMomentum = new float[weights]();
+			_biasMomentum = new float[layerSize]();
+		}
+		float range = 1.0f / sqrtf((float)_prevLayer->_layerSize);
+		for (int i = 0; i < weights; ++i)
+		{
+			_weights[i] = range * (2.0f * rand() / RAND_MAX - 1.0f);
+		}
+	}
+
+	Layer::~Layer()
+	{
+		delete[] _outputs;
+		delete[] _biases;
+		delete[] _weights;
+		delete[] _error;
+		delete[] _deltaWeights;
+		delete[] _deltaBiases;
+		delete[] _weightMomentum;
+		delete[] _biasMomentum;
+	}
+
+	void Layer::propagateForward()
+	{
+		int inputs = _prevLayer->_layerSize;
+		const float* input = _prevLayer->_outputs;
+		for (int i = 0; i < _layerSize; ++i)
+		{
+			const float* row = _weights + i * inputs;
+			float sum = _biases[i];
+			for (int j = 0; j < inputs; ++j)
+			{
+				sum += row[j] * input[j];
+			}
+			_outputs[i] = activate(_actfunc, sum);
+		}
+	}
+
+	// Error of a hidden layer from the errors and weights of the next one
+	void Layer::calculateError()
+	{
+		int nodes = _nextLayer->_layerSize;
+		for (int i = 0; i < _layerSize; ++i)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < nodes; ++k)
+			{
+				sum += _nextLayer->_weights[k * _layerSize + i] * _nextLayer->_error[k];
+			}
+			_error[i] = sum;
+		}
+	}
+
+	void Layer::calculateDerivative()
+	{
+		for (int i = 0; i < _layerSize; ++i)
+		{
+			_error[i] *= derivative(_actfunc, _outputs[i]);
+		}
+	}
+
+	// Accumulates the gradients of one sample, update applies them
+	void Layer::calculateDelta()
+	{
+		int inputs = _prevLayer->_layerSize;
+		const float* input = _prevLayer->_outputs;
+		for (int i = 0; i < _layerSize; ++i)
+		{
+			float* row = _deltaWeights + i * inputs;
+			for (int j = 0; j < inputs; ++j)
+			{
+				row[j] += _error[i] * input[j];
+			}
+			_deltaBiases[i] += _error[i];
+		}
+	}
+
+	void Layer::propagateBackward()
+	{
+		calculateError();
+		calculateDerivative();
+		calculateDelta();
+	}
+
+	// Output layer, error is the output minus the label
+	void Layer::propagateBackward(const float* const error)
+	{
+		for (int i = 0; i < _layerSize; ++i)
+		{
+			_error[i] = _outputs[i] - error[i];
+		}
+		calculateDerivative();
+		calculateDelta();
+	}
+
+	// Steps by the mean gradient of epochs samples and clears the gradients
+	void Layer::update(const float learningRate, const int epochs)
+	{
+		float scale = learningRate / epochs;
+		int weights = _layerSize * _prevLayer->_layerSize;
+		if (_weightMomentum != nullptr)
+		{
+			for (int i = 0; i < weights; ++i)
+			{
+				_weightMomentum[i] = _momentum * _weightMomentum[i] + scale * _deltaWeights[i];
+				_weights[i] -= _weightMomentum[i];
+			}
+			for (int i = 0; i < _layerSize; ++i)
+			{
+				_biasMomentum[i] = _momentum * _biasMomentum[i] + scale * _deltaBiases[i];
+				_biases[i] -= _biasMomentum[i];
+			}
+		}
+		else
+		{
+			for (int i = 0; i < weights; ++i)
+			{
+				_weights[i] -= scale * _deltaWeights[i];
+			}
+			for (int i = 0; i < _layerSize; ++i)
+			{
+				_biases[i] -= scale * _deltaBiases[i];
+			}
+		}
+		for (int i = 0; i < weights; ++i)
+		{
+			_deltaWeights[i] = 0.0f;
+		}
+		for (int i = 0; i < _layerSize; ++i)
+		{
+			_deltaBiases[i] = 0.0f;
+		}
+	}
+}
\ No newline at end of file
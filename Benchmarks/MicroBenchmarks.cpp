@@ -0,0 +1,382 @@
+#include <ANNetwork.h>
+#include <Layer.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <random>
+#include "BoardState.h"
+#include "Fen.h"
+#include "Trainer.h"
+#include "Kernels.h"
+#include "GameLog.h"
+
+namespace BoardState
+{
+	// Random playout positions from a fixed seed, so every run times the same positions
+	static const int BENCH_POSITIONS = 1024;
+	static const unsigned int BENCH_SEED = 1;
+	// Repetitions of every benchmark, the median is reported
+	static const int BENCH_REPETITIONS = 5;
+	static const int BENCH_MILLISECONDS = 200;
+	// Random games written to a game log in the working directory for the reader benchmark, removed afterwards
+	static const char* BENCH_LOG_FILE = "NeverchessBench.games";
+	static const int BENCH_LOG_GAMES = 256;
+	static const int BENCH_LOG_PLIES = 160;
+	// Added to the playouts, they have castling, en passant and promotions in reach
+	static const char* BENCH_FENS[] =
+	{
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+		"4k3/1P6/8/8/8/8/6p1/4K3 w - - 0 1"
+	};
+
+	struct BenchmarkResult
+	{
+		std::string name;
+		long long iterations = 0;
+		double nsPerOp = 0.0;
+		double minNsPerOp = 0.0;
+		double maxNsPerOp = 0.0;
+
+		double opsPerSecond() const { return nsPerOp > 0.0 ? 1e9 / nsPerOp : 0.0; }
+	};
+
+	// Times the hot paths of search and training one function at a time on a fixed position set. An operation is one
+	// call on one position, except trainBatch, which is one mini-batch step. Every benchmark is calibrated to run for
+	// about milliseconds per repetition, and the median of the repetitions is reported with the fastest and slowest.
+	class MicroBenchmarks
+	{
+	private:
+		BoardManager manager;
+		AnnUtilities::ANNetwork ann;
+		std::vector<BoardStateData> positions;
+		std::vector<std::vector<MoveData>> rawMoves;
+		// Every legal move of every position, with the index of its position
+		std::vector<std::pair<int, MoveData>> legal;
+		// Hashes of the positions and of all their children, the keys of the transposition table benchmarks
+		std::vector<unsigned long int> hashes;
+		int milliseconds;
+		// Results are summed here, so the compiler cannot drop the calls
+		unsigned long long sink = 0;
+
+		BenchmarkResult measure					(const std::string& name, const std::function<void(long long)>& ops);
+
+	public:
+		MicroBenchmarks							(int milliseconds);
+		std::vector<BenchmarkResult> run		(const std::string& filter);
+		int positionCount						() const { return (int)positions.size(); }
+	};
+
+	MicroBenchmarks::MicroBenchmarks(int milliseconds) : milliseconds(milliseconds)
+	{
+		AnnUtilities::ANNSettings annSettings;
+		annSettings._hiddenActicationFunction = AnnUtilities::ACTFUNC::TANH;
+		annSettings._outputActicationFunction = AnnUtilities::ACTFUNC::SIGMOID;
+		annSettings._inputSize = ANN_INPUT_LENGTH;
+		annSettings._hiddenSize = 900;
+		annSettings._outputSize = 1;
+		annSettings._numberOfHiddenLayers = 3;
+		ann._settings = annSettings;
+		ann.Init();
+		manager.calculateZobristValues();
+		manager.setVerbose(false);
+
+		positions = manager.samplePositions(BENCH_POSITIONS, BENCH_SEED);
+		for (const char* fen : BENCH_FENS)
+		{
+			BoardStateData boardStateData;
+			if (parseFen(fen, boardStateData))
+			{
+				positions.push_back(boardStateData);
+			}
+		}
+		for (int i = 0; i < (int)positions.size(); ++i)
+		{
+			rawMoves.push_back(manager.genRawMoves(positions[i]));
+			hashes.push_back(manager.zobristHash(positions[i]));
+			std::vector<MoveData> moves = rawMoves.back();
+			for (const BoardStateData& child : manager.filterMoves(positions[i], moves))
+			{
+				hashes.push_back(manager.zobristHash(child));
+			}
+			for (const MoveData& move : moves)
+			{
+				legal.push_back({ i, move });
+			}
+		}
+	}
+
+	BenchmarkResult MicroBenchmarks::measure(const std::string& name, const std::function<void(long long)>& ops)
+	{
+		typedef std::chrono::steady_clock Clock;
+		auto time = [&ops](long long count)
+		{
+			Clock::time_point begin = Clock::now();
+			ops(count);
+			return std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+		};
+
+		// Warms the caches, then doubles the count until a run is long enough to scale from
+		ops(1);
+		long long count = 1;
+		double elapsed;
+		while ((elapsed = time(count)) < 1e7 && count < (1LL << 40))
+		{
+			count *= 2;
+		}
+		count = std::max(1LL, (long long)(count * (milliseconds * 1e6) / std::max(elapsed, 1.0)));
+
+		std::vector<double> nsPerOp;
+		for (int i = 0; i < BENCH_REPETITIONS; ++i)
+		{
+			nsPerOp.push_back(time(count) / count);
+		}
+		std::sort(nsPerOp.begin(), nsPerOp.end());
+		BenchmarkResult result;
+		result.name = name;
+		result.iterations = count * BENCH_REPETITIONS;
+		result.nsPerOp = nsPerOp[BENCH_REPETITIONS / 2];
+		result.minNsPerOp = nsPerOp.front();
+		result.maxNsPerOp = nsPerOp.back();
+		return result;
+	}
+
+	// Runs the benchmarks whose name contains filter, all of them when it is empty
+	std::vector<BenchmarkResult> MicroBenchmarks::run(const std::string& filter)
+	{
+		long long n = (long long)positions.size();
+		long long m = (long long)legal.size();
+		long long keys = (long long)hashes.size();
+		std::vector<std::pair<std::string, std::function<void(long long)>>> benchmarks;
+		Trainer trainer;
+		std::vector<TrainingSample> samples;
+		std::vector<float> errors;
+		bool tableFilled = false;
+		GameLogReader logReader;
+		long long logPositions = 0;
+
+		benchmarks.push_back({ "genRawMoves", [&](long long count)
+		{
+			for (long long i = 0; i < count; ++i)
+			{
+				sink += manager.genRawMoves(positions[i % n]).size();
+			}
+		} });
+		// The copy of the raw moves filterMoves prunes is part of the operation
+		benchmarks.push_back({ "filterMoves", [&](long long count)
+		{
+			for (long long i = 0; i < count; ++i)
+			{
+				std::vector<MoveData> moves = rawMoves[i % n];
+				sink += manager.filterMoves(positions[i % n], moves).size();
+			}
+		} });
+		// So is the copy of the board the move is played on
+		benchmarks.push_back({ "playMove", [&](long long count)
+		{
+			BoardStateData boardStateData;
+			for (long long i = 0; i < count; ++i)
+			{
+				const std::pair<int, MoveData>& move = legal[i % m];
+				boardStateData.copy(positions[move.first]);
+				manager.playMove(boardStateData, move.second);
+				sink += boardStateData._turn;
+			}
+		} });
+		benchmarks.push_back({ "zobristHash", [&](long long count)
+		{
+			for (long long i = 0; i < count; ++i)
+			{
+				sink += manager.zobristHash(positions[i % n]);
+			}
+		} });
+		// One square per operation, all 64 squares of a position in turn
+		benchmarks.push_back({ "squareThreatened", [&](long long count)
+		{
+			for (long long i = 0; i < count; ++i)
+			{
+				const BoardStateData& boardStateData = positions[(i >> 6) % n];
+				sink += manager.squareThreatened(boardStateData._pieces, boardStateData._turn, i & 7, (i >> 3) & 7);
+			}
+		} });
+		benchmarks.push_back({ "setANNInput", [&](long long count)
+		{
+			for (long long i = 0; i < count; ++i)
+			{
+				manager.setANNInput(positions[i % n], ann._inputLayer);
+				sink += ann._inputLayer->_outputs[i % ANN_INPUT_LENGTH] > 0.0f;
+			}
+		} });
+		// The float network the trainer copies from, dense over all inputs
+		benchmarks.push_back({ "propagateForward", [&](long long count)
+		{
+			manager.setANNInput(positions[0], ann._inputLayer);
+			for (long long i = 0; i < count; ++i)
+			{
+				ann.propagateForward();
+				sink += ann._outputLayer->_outputs[0] > 0.5f;
+			}
+		} });
+		// One step of the training loop trainReplay runs, TRAINING_BATCH_SIZE samples per operation
+		benchmarks.push_back({ "trainBatch", [&](long long count)
+		{
+			int batch = trainer.getBatchSize();
+			if (samples.empty())
+			{
+				trainer.load(ann);
+				for (long long i = 0; i < n; ++i)
+				{
+					samples.push_back(TrainingSample{ &positions[i], i % 2 ? HIGH_LABEL : LOW_LABEL });
+				}
+				errors.resize(batch);
+			}
+			for (long long i = 0; i < count; ++i)
+			{
+				sink += trainer.trainBatch(&samples[(i * batch) % (n - batch)], batch, 0.01f, &errors[0]) > 0.0f;
+			}
+		} });
+		// Stores into the search's own table, which is emptied whenever every key has been stored
+		benchmarks.push_back({ "ttStore", [&](long long count)
+		{
+			AlphaBetaEvaluation evaluation{ MoveData(), 0.5f };
+			tableFilled = false;
+			for (long long i = 0; i < count; ++i)
+			{
+				if (i % keys == 0)
+				{
+					manager.boardEvaluations.clear();
+				}
+				sink += manager.boardEvaluations.insert({ hashes[i % keys], evaluation }).second;
+			}
+		} });
+		// A table that holds every key, every other probe misses
+		benchmarks.push_back({ "ttProbe", [&](long long count)
+		{
+			if (!tableFilled)
+			{
+				AlphaBetaEvaluation evaluation{ MoveData(), 0.5f };
+				manager.boardEvaluations.clear();
+				for (unsigned long int hash : hashes)
+				{
+					manager.boardEvaluations.insert({ hash, evaluation });
+				}
+				tableFilled = true;
+			}
+			for (long long i = 0; i < count; ++i)
+			{
+				unsigned long int hash = hashes[(i >> 1) % keys] ^ (i & 1 ? 0x5bd1e995UL : 0UL);
+				sink += manager.boardEvaluations.find(hash) != manager.boardEvaluations.end();
+			}
+		} });
+		// Positions replayed out of a mapped game log, as offline training reads them. The log is read whole, so the
+		// count is rounded up to full passes, which the calibration makes small against the positions timed.
+		benchmarks.push_back({ "gameLogPositions", [&](long long count)
+		{
+			if (logPositions == 0)
+			{
+				std::mt19937 random(BENCH_SEED);
+				GameLogWriter writer;
+				std::remove(BENCH_LOG_FILE);
+				std::remove((std::string(BENCH_LOG_FILE) + ".idx").c_str());
+				writer.open(BENCH_LOG_FILE);
+				for (int g = 0; g < BENCH_LOG_GAMES; ++g)
+				{
+					PlayedGame game;
+					manager.resetBoardStateData(game.start);
+					BoardStateData boardStateData;
+					boardStateData.copy(game.start);
+					std::vector<MoveData> moves;
+					for (int ply = 0; ply < BENCH_LOG_PLIES && !(moves = manager.legalMoves(boardStateData)).empty(); ++ply)
+					{
+						game.moves.push_back(moves[random() % moves.size()]);
+						game.values.push_back(0.5f);
+						applyMove(boardStateData, game.moves.back());
+					}
+					logPositions += (long long)game.moves.size();
+					writer.write(game);
+				}
+				writer.close();
+				logReader.open(BENCH_LOG_FILE);
+			}
+			for (long long i = 0; i < count; i += logPositions)
+			{
+				logReader.forEachPosition([&](const BoardStateData& boardStateData, float value, int, int ply)
+				{
+					sink += boardStateData._turn + (value > 0.5f) + ply;
+				});
+			}
+		} });
+
+		std::vector<BenchmarkResult> results;
+		for (const auto& benchmark : benchmarks)
+		{
+			if (benchmark.first.find(filter) != std::string::npos)
+			{
+				results.push_back(measure(benchmark.first, benchmark.second));
+				const BenchmarkResult& result = results.back();
+				std::cout << std::left << std::setw(20) << result.name << std::right << std::fixed << std::setprecision(1)
+					<< std::setw(14) << result.nsPerOp << " ns/op" << std::setw(16) << std::setprecision(0) << result.opsPerSecond()
+					<< " ops/s  [" << std::setprecision(1) << result.minNsPerOp << " - " << result.maxNsPerOp << "]" << std::endl;
+			}
+		}
+		if (logPositions > 0)
+		{
+			logReader.close();
+			std::remove(BENCH_LOG_FILE);
+			std::remove((std::string(BENCH_LOG_FILE) + ".idx").c_str());
+		}
+		return results;
+	}
+
+	// One benchmark per line in a fixed order, so two runs diff line by line
+	static void writeJson(std::ostream& out, const std::vector<BenchmarkResult>& results, int positions, int milliseconds)
+	{
+		out << std::fixed << std::setprecision(3);
+		out << "{\n";
+		out << "\t\"context\": { \"simd\": \"" << AnnUtilities::simdLevelName(AnnUtilities::kernels().level) << "\", \"positions\": " << positions
+			<< ", \"repetitions\": " << BENCH_REPETITIONS << ", \"milliseconds\": " << milliseconds << " },\n";
+		out << "\t\"benchmarks\": [\n";
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const BenchmarkResult& result = results[i];
+			out << "\t\t{ \"name\": \"" << result.name << "\", \"iterations\": " << result.iterations << ", \"ns_per_op\": " << result.nsPerOp
+				<< ", \"min_ns_per_op\": " << result.minNsPerOp << ", \"max_ns_per_op\": " << result.maxNsPerOp
+				<< ", \"ops_per_sec\": " << result.opsPerSecond() << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		out << "\t]\n";
+		out << "}\n";
+	}
+}
+
+// NeverchessBench [json file] [milliseconds per repetition] [name filter]
+int main(int argc, char* argv[])
+{
+	std::string jsonFile = argc > 1 ? argv[1] : "";
+	int milliseconds = argc > 2 ? std::max(1, atoi(argv[2])) : BoardState::BENCH_MILLISECONDS;
+	std::string filter = argc > 3 ? argv[3] : "";
+
+	std::cout << "Using " << AnnUtilities::simdLevelName(AnnUtilities::kernels().level) << " kernels" << std::endl;
+	BoardState::MicroBenchmarks benchmarks(milliseconds);
+	std::vector<BoardState::BenchmarkResult> results = benchmarks.run(filter);
+	if (!jsonFile.empty())
+	{
+		std::ofstream out(jsonFile);
+		if (!out)
+		{
+			std::cerr << jsonFile << ": could not create file" << std::endl;
+			return 1;
+		}
+		BoardState::writeJson(out, results, benchmarks.positionCount(), milliseconds);
+	}
+	return 0;
+}
\ No newline at end of file
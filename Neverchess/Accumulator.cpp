@@ -0,0 +1,183 @@
+#include "Accumulator.h"
+#include "BoardState.h"
+#include "Kernels.h"
+#include <algorithm>
+
+namespace BoardState
+{
+	// Castle inputs in the order setANNInput writes them: white queen side, white king side, black queen side, black
+	// king side
+	static bool castleInput(const BoardStateData& boardStateData, int i)
+	{
+		int side = i / 2;
+		if (boardStateData._kingMoved[side])
+		{
+			return false;
+		}
+		return i % 2 == 0 ? !boardStateData._qRookMoved[side] : !boardStateData._kRookMoved[side];
+	}
+
+	void Accumulator::addColumn(float* values, int input, float sign)
+	{
+		AnnUtilities::kernels().axpy(values, network->column(input), sign, hiddenSize);
+	}
+
+	// First hidden layer pre-activations as the biases plus the columns of the active inputs
+	static void computeSparse(const AnnUtilities::InferenceNetwork& network, const BoardStateData& boardStateData, float* values)
+	{
+		const AnnUtilities::KernelTable& k = AnnUtilities::kernels();
+		int active[ANN_MAX_ACTIVE_INPUTS];
+		int count = activeANNInputs(boardStateData, active, ANN_MAX_ACTIVE_INPUTS);
+		int hiddenSize = network.hiddenSize();
+		std::copy(network.firstBiases(), network.firstBiases() + hiddenSize, values);
+		for (int i = 0; i < count; ++i)
+		{
+			k.axpy(values, network.column(active[i]), 1.0f, hiddenSize);
+		}
+	}
+
+	float evaluate(const AnnUtilities::InferenceNetwork& network, const BoardStateData& boardStateData, EvaluationScratch& scratch)
+	{
+		if ((int)scratch.preactivations.size() != network.hiddenSize())
+		{
+			scratch.preactivations.resize(network.hiddenSize());
+			network.prepare(scratch.activations);
+		}
+		computeSparse(network, boardStateData, &scratch.preactivations[0]);
+		return network.forward(&scratch.preactivations[0], scratch.activations);
+	}
+
+	void evaluateBatch(const AnnUtilities::InferenceNetwork& network, const std::vector<const BoardStateData*>& positions, float* values, EvaluationScratch& scratch)
+	{
+		if (positions.empty())
+		{
+			return;
+		}
+		int hiddenSize = network.hiddenSize();
+		scratch.batchPreactivations.resize((size_t)hiddenSize * positions.size());
+		for (unsigned int i = 0; i < positions.size(); ++i)
+		{
+			computeSparse(network, *positions[i], &scratch.batchPreactivations[(size_t)i * hiddenSize]);
+		}
+		network.forwardBatch(&scratch.batchPreactivations[0], (int)positions.size(), scratch.activations, values);
+	}
+
+	// Indices of the inputs setANNInput sets to 1, every other input is 0. Returns the number of active inputs. At most
+	// capacity are written, a board with more than 16 pieces a side would need more than ANN_MAX_ACTIVE_INPUTS.
+	int activeANNInputs(const BoardStateData& boardStateData, int active[], int capacity)
+	{
+		int count = 0;
+		if (boardStateData._turn && count < capacity)
+		{
+			active[count++] = ANN_TURN_INPUT;
+		}
+		for (int i = 0; i < 4; ++i)
+		{
+			if (castleInput(boardStateData, i) && count < capacity)
+			{
+				active[count++] = ANN_CASTLE_INPUT + i;
+			}
+		}
+		if (boardStateData._enPassant != -1 && count < capacity)
+		{
+			active[count++] = ANN_EN_PASSANT_INPUT + boardStateData._enPassant;
+		}
+		for (int square = 0; square < BOARD_LENGTH * BOARD_LENGTH; ++square)
+		{
+			int piece = (int)boardStateData._pieces[square];
+			for (int bit = 0; piece != 0; ++bit, piece >>= 1)
+			{
+				if ((piece & 1) && count < capacity)
+				{
+					active[count++] = ANN_PIECE_INPUT + square * PIECE_CODE_LENGTH + bit;
+				}
+			}
+		}
+		return count;
+	}
+
+	// Builds a private inference copy of the trained network. Has to be called again after the weights change.
+	void Accumulator::load(const AnnUtilities::ANNetwork& trained)
+	{
+		attach(trained, std::make_shared<const AnnUtilities::InferenceNetwork>(trained, false));
+	}
+
+	// Evaluates with an inference copy of trained that other accumulators may be using as well
+	void Accumulator::attach(const AnnUtilities::ANNetwork& trained, std::shared_ptr<const AnnUtilities::InferenceNetwork> shared)
+	{
+		network = shared;
+		source = &trained;
+		hiddenSize = network->hiddenSize();
+		network->prepare(scratch.activations);
+		scratch.preactivations.resize(hiddenSize);
+		stack.resize(MAX_SEARCH_PLY * hiddenSize);
+	}
+
+	// Computes the search root from scratch, the rest of the search is updated incrementally
+	void Accumulator::refresh(const BoardStateData& boardStateData)
+	{
+		computeSparse(*network, boardStateData, &stack[0]);
+	}
+
+	// Writes the pre-activations of child to ply + 1 from the ones of parent at ply
+	void Accumulator::update(int ply, const BoardStateData& parent, const BoardStateData& child)
+	{
+		const float* from = &stack[ply * hiddenSize];
+		float* values = &stack[(ply + 1) * hiddenSize];
+		for (int i = 0; i < hiddenSize; ++i)
+		{
+			values[i] = from[i];
+		}
+		if (parent._turn != child._turn)
+		{
+			addColumn(values, ANN_TURN_INPUT, child._turn ? 1.0f : -1.0f);
+		}
+		for (int i = 0; i < 4; ++i)
+		{
+			bool before = castleInput(parent, i);
+			if (before != castleInput(child, i))
+			{
+				addColumn(values, ANN_CASTLE_INPUT + i, before ? -1.0f : 1.0f);
+			}
+		}
+		if (parent._enPassant != child._enPassant)
+		{
+			if (parent._enPassant != -1)
+			{
+				addColumn(values, ANN_EN_PASSANT_INPUT + parent._enPassant, -1.0f);
+			}
+			if (child._enPassant != -1)
+			{
+				addColumn(values, ANN_EN_PASSANT_INPUT + child._enPassant, 1.0f);
+			}
+		}
+		for (int square = 0; square < BOARD_LENGTH * BOARD_LENGTH; ++square)
+		{
+			int before = (int)parent._pieces[square];
+			int after = (int)child._pieces[square];
+			if (before == after)
+			{
+				continue;
+			}
+			for (int bit = 0; bit < PIECE_CODE_LENGTH; ++bit)
+			{
+				int changed = ((before ^ after) >> bit) & 1;
+				if (changed)
+				{
+					addColumn(values, ANN_PIECE_INPUT + square * PIECE_CODE_LENGTH + bit, ((after >> bit) & 1) ? 1.0f : -1.0f);
+				}
+			}
+		}
+	}
+
+	float Accumulator::propagate(int ply)
+	{
+		return network->forward(&stack[ply * hiddenSize], scratch.activations);
+	}
+
+	// Evaluates a single position without touching the search stack
+	float Accumulator::evaluate(const BoardStateData& boardStateData)
+	{
+		return BoardState::evaluate(*network, boardStateData, scratch);
+	}
+}
\ No newline at end of file
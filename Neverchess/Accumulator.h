@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <ANNetwork.h>
+#include <Layer.h>
+#include <memory>
+#include "InferenceNetwork.h"
+
+namespace BoardState
+{
+	struct BoardStateData;
+
+	static const int ANN_TURN_INPUT = 0;
+	static const int ANN_CASTLE_INPUT = 1;
+	static const int ANN_EN_PASSANT_INPUT = 5;
+	static const int ANN_PIECE_INPUT = 13;
+	static const int MAX_SEARCH_PLY = 64;
+	// turn, castles, en passant column and at most two set bits for each of the 32 pieces
+	static const int ANN_MAX_ACTIVE_INPUTS = 1 + 4 + 1 + 32 * 2;
+
+	// Activations of one thread evaluating single positions or batches of them
+	struct EvaluationScratch
+	{
+		AnnUtilities::InferenceScratch activations;
+		std::vector<float> preactivations;
+		std::vector<float> batchPreactivations;
+	};
+
+	int activeANNInputs							(const BoardStateData& boardStateData, int active[], int capacity);
+	// Network output for a position. Only the scratch is written, so threads can share the weights.
+	float evaluate								(const AnnUtilities::InferenceNetwork& network, const BoardStateData& boardStateData, EvaluationScratch& scratch);
+	// Network outputs for several positions in one forward pass, values gets one per position
+	void evaluateBatch							(const AnnUtilities::InferenceNetwork& network, const std::vector<const BoardStateData*>& positions, float* values, EvaluationScratch& scratch);
+
+	// Pre-activations of the first hidden layer kept for every ply of the search. A child position differs from its
+	// parent by a few inputs only, so its pre-activations are the parent's plus or minus the weight columns of the
+	// inputs that changed. The network stores the first layer input-major to make a column contiguous, which also lets a
+	// single position be evaluated by summing the columns of its active inputs instead of multiplying the mostly zero input.
+	// The weights are a shared read-only InferenceNetwork, the stack and activations belong to the accumulator.
+	class Accumulator
+	{
+	private:
+		const AnnUtilities::ANNetwork* source = nullptr;
+		std::shared_ptr<const AnnUtilities::InferenceNetwork> network;
+		EvaluationScratch scratch;
+		int hiddenSize = 0;
+		std::vector<float> stack;
+
+		void addColumn							(float* values, int input, float sign);
+
+	public:
+		bool loaded								(const AnnUtilities::ANNetwork& trained) const { return source == &trained; }
+		void invalidate							() { source = nullptr; }
+		void load								(const AnnUtilities::ANNetwork& trained);
+		void attach								(const AnnUtilities::ANNetwork& trained, std::shared_ptr<const AnnUtilities::InferenceNetwork> shared);
+		std::shared_ptr<const AnnUtilities::InferenceNetwork> weights() const { return network; }
+		void refresh							(const BoardStateData& boardStateData);
+		void update								(int ply, const BoardStateData& parent, const BoardStateData& child);
+		float propagate							(int ply);
+		float evaluate							(const BoardStateData& boardStateData);
+	};
+}
\ No newline at end of file
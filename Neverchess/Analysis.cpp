@@ -0,0 +1,158 @@
+#include "Analysis.h"
+#include "Fen.h"
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+
+namespace BoardState
+{
+	void BatchAnalysis::init(int threads)
+	{
+		workers.resize(std::max(1, threads));
+		for (std::unique_ptr<BoardManager>& worker : workers)
+		{
+			if (!worker)
+			{
+				worker.reset(new BoardManager());
+				worker->calculateZobristValues();
+				worker->setVerbose(false);
+			}
+		}
+	}
+
+	// A depth of 0 searches until the time is up
+	void BatchAnalysis::setSearch(int depth, int time)
+	{
+		maxDepth = depth > 0 ? depth : ANALYSIS_MAX_DEPTH;
+		milliseconds = time;
+	}
+
+	void BatchAnalysis::analyse(BoardManager& worker, AnnUtilities::ANNetwork& network, Job& job)
+	{
+		job.valid = parseFen(job.line, job.boardStateData);
+		if (!job.valid)
+		{
+			return;
+		}
+		size_t at = job.line.find(" bm ");
+		if (at != std::string::npos)
+		{
+			std::string moves = job.line.substr(at + 4, job.line.find(';', at) - at - 4);
+			size_t begin = 0;
+			while ((begin = moves.find_first_not_of(' ', begin)) != std::string::npos)
+			{
+				size_t end = std::min(moves.find(' ', begin), moves.size());
+				MoveData move;
+				if (worker.parseSan(job.boardStateData, moves.substr(begin, end - begin), move))
+				{
+					job.bestMoves.push_back(move);
+				}
+				begin = end;
+			}
+		}
+		worker.reset();
+		job.result = worker.iterativeSearch(job.boardStateData, network, maxDepth, milliseconds);
+		for (const MoveData& move : job.bestMoves)
+		{
+			job.solved = job.solved || sameMove(move, job.result.evaluation.move);
+		}
+	}
+
+	AnalysisSummary BatchAnalysis::run(AnnUtilities::ANNetwork& network, const std::string& positionFile, const std::string& resultFile)
+	{
+		std::ifstream in(positionFile);
+		if (!in)
+		{
+			throw std::runtime_error(positionFile + ": could not open file");
+		}
+		std::ofstream out(resultFile);
+		if (!out)
+		{
+			throw std::runtime_error(resultFile + ": could not create file");
+		}
+		if (workers.empty())
+		{
+			init(1);
+		}
+		std::shared_ptr<const AnnUtilities::InferenceNetwork> shared = std::make_shared<const AnnUtilities::InferenceNetwork>(network, false);
+		if (useQuantized)
+		{
+			quantized.quantize(*shared);
+		}
+		for (std::unique_ptr<BoardManager>& worker : workers)
+		{
+			worker->shareNetwork(network, shared);
+			worker->setQuantizedNetwork(useQuantized ? &quantized : nullptr);
+		}
+
+		AnalysisSummary summary;
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		out << "fen\tmove\tvalue\tdepth\tnodes\tms\tbm\n";
+		std::vector<Job> jobs;
+		std::string line;
+		while (in)
+		{
+			jobs.clear();
+			while ((int)jobs.size() < ANALYSIS_BLOCK && std::getline(in, line))
+			{
+				if (!line.empty() && line.back() == '\r')
+				{
+					line.pop_back();
+				}
+				if (line.find_first_not_of(" \t") != std::string::npos && line[0] != '#')
+				{
+					jobs.push_back(Job());
+					jobs.back().line = line;
+				}
+			}
+
+			// Threads take the next position as soon as they finish one, a slow position does not hold up the others
+			std::atomic<int> next(0);
+			auto work = [&](BoardManager* worker)
+			{
+				int i;
+				while ((i = next++) < (int)jobs.size())
+				{
+					analyse(*worker, network, jobs[i]);
+				}
+			};
+			std::vector<std::thread> threads;
+			for (unsigned int i = 1; i < workers.size(); ++i)
+			{
+				threads.push_back(std::thread(work, workers[i].get()));
+			}
+			work(workers[0].get());
+			for (std::thread& t : threads)
+			{
+				t.join();
+			}
+
+			for (const Job& job : jobs)
+			{
+				++summary.positions;
+				if (!job.valid)
+				{
+					++summary.invalid;
+					out << job.line << "\tinvalid\n";
+					continue;
+				}
+				summary.nodes += job.result.nodes;
+				summary.withBestMove += !job.bestMoves.empty();
+				summary.solved += job.solved;
+				out << writeFen(job.boardStateData) << '\t' << writeMove(job.result.evaluation.move, job.boardStateData._turn)
+					<< '\t' << job.result.evaluation.evaluatedValue << '\t' << job.result.depth << '\t' << job.result.nodes
+					<< '\t' << job.result.milliseconds << '\t' << (job.bestMoves.empty() ? "-" : job.solved ? "solved" : "missed") << '\n';
+			}
+			out.flush();
+		}
+		if (!out)
+		{
+			throw std::runtime_error(resultFile + ": could not write file");
+		}
+		summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		return summary;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <ANNetwork.h>
+#include "BoardState.h"
+
+namespace BoardState
+{
+	// Lines read, searched and written together, the only part of the files held in memory
+	static const int ANALYSIS_BLOCK = 1024;
+	// Deepest iteration of a search that is only limited by time
+	static const int ANALYSIS_MAX_DEPTH = 64;
+
+	struct AnalysisSummary
+	{
+		int positions = 0;
+		int invalid = 0;
+		// Positions with a bm opcode and how many of them the search solved
+		int withBestMove = 0;
+		int solved = 0;
+		long long nodes = 0;
+		double seconds = 0.0;
+	};
+
+	// Searches every position of a file of FEN or EPD lines on several threads and writes a tab separated line per
+	// position in input order: FEN, best move, value, depth, nodes, milliseconds and whether the move matches the
+	// bm opcode of an EPD line, so a test suite doubles as a regression test. Searches are fixed depth, or iterative
+	// deepening for a fixed time when milliseconds is set, evaluating with the float network or with an int8/int16
+	// copy of it. Like SelfPlay every thread has a BoardManager of its own and all of them share one read-only copy
+	// of the weights.
+	class BatchAnalysis
+	{
+	private:
+		struct Job
+		{
+			std::string line;
+			BoardStateData boardStateData;
+			bool valid = false;
+			std::vector<MoveData> bestMoves;
+			bool solved = false;
+			SearchResult result;
+		};
+
+		std::vector<std::unique_ptr<BoardManager>> workers;
+		int maxDepth = 4;
+		int milliseconds = 0;
+		bool useQuantized = false;
+		QuantizedNetwork quantized;
+
+		void analyse							(BoardManager& worker, AnnUtilities::ANNetwork& network, Job& job);
+
+	public:
+		void init								(int threads);
+		void setSearch							(int depth, int time);
+		void setQuantized						(bool enabled) { useQuantized = enabled; }
+		int threads								() const { return (int)workers.size(); }
+		AnalysisSummary run						(AnnUtilities::ANNetwork& network, const std::string& positionFile, const std::string& resultFile);
+	};
+}
\ No newline at end of file
@@ -3,56 +3,238 @@
 #include "MoveData.h"
 #include "ANNetwork.h"
 #include "Layer.h"
+#include "ModelFile.h"
 #include <math.h>
 #include <algorithm>
 #include <iostream>
 #include <random>
 #include <fstream>
 #include <time.h>
+#include <climits>
 #include <chrono>
 #include <string>
 #include <thread>
 
-#define HIGH_LABEL 1.0f
-#define LOW_LABEL 0.0f
-
 namespace BoardState
 {
 	void BoardManager::process(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int evaluationDepth, int maxTurns)
 	{
 		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 		int turn = 0;
+		int resignCount = 0;
+		int drawCount = 0;
 		AlphaBetaEvaluation eval;
+		if (alphaBetaHistory.empty())
+		{
+			gameStart = boardStateData;
+		}
 
+		gameEnd = GameEnd::MAX_TURNS;
 		while (turn < maxTurns)
 		{
-			eval = alphaBeta(boardStateData, network, evaluationDepth, -1000.0f, 1000.0f);
-			alphaBetaHistory.push(eval);
-			playMove(boardStateData, eval.move);
-			checkWinner(boardStateData);
-			if (whiteWin || blackWin)
+			if (searchMode == SearchMode::MCTS)
 			{
-				break;
+				eval = mcts(boardStateData, network, mctsPlayouts);
 			}
+			else
+			{
+				eval = alphaBeta(boardStateData, network, evaluationDepth, -1000.0f, 1000.0f);
+			}
+			alphaBetaHistory.push(eval);
+			playMove(boardStateData, eval.move);
+			GameEnd ending = checkWinner(boardStateData);
 			//std::cout << "(" << eval.move.xStart << ", " << eval.move.yStart << ") -> (" << eval.move.xEnd << ", " << eval.move.yEnd << ")" << std::endl;
 			//printBoard(boardStateData);
-			if (positionAppeared(boardStateData) > 2)
+			if (ending == GameEnd::NONE && positionAppeared(boardStateData) > 2)
 			{
-				std::cout << "Draw by repetition" << std::endl;
-				blackWin = false;
-				whiteWin = false;
+				ending = GameEnd::REPETITION;
+			}
+			if (ending == GameEnd::NONE && boardStateData._halfmoveClock >= FIFTY_MOVE_PLIES)
+			{
+				ending = GameEnd::FIFTY_MOVES;
+			}
+			if (ending == GameEnd::NONE && insufficientMaterial(boardStateData))
+			{
+				ending = GameEnd::INSUFFICIENT_MATERIAL;
+			}
+			if (ending == GameEnd::NONE && adjudication.enabled)
+			{
+				ending = adjudicate(eval.evaluatedValue, turn + 1, resignCount, drawCount);
+			}
+			if (ending != GameEnd::NONE)
+			{
+				gameEnd = ending;
+				if (verbose && ending != GameEnd::CHECKMATE)
+				{
+					std::cout << "Game ended by " << gameEndName(ending) << std::endl;
+				}
 				break;
 			}
 			++turn;
 		}
 		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-		std::cout << "turn: " << turn << ", elapsed time: " << std::chrono::duration_cast<std::chrono::seconds>(end - begin).count()
-			<< ", white win = " << whiteWin << ", black win = " << blackWin << std::endl;
-		printBoard(boardStateData);
+		if (verbose)
+		{
+			std::cout << "turn: " << turn << ", elapsed time: " << std::chrono::duration_cast<std::chrono::seconds>(end - begin).count()
+				<< ", white win = " << whiteWin << ", black win = " << blackWin << std::endl;
+			printBoard(boardStateData);
+		}
+	}
+
+	// Counts consecutive decisive and drawish search values of the game. A game being audited only remembers the first
+	// result adjudication would have given and plays on.
+	GameEnd BoardManager::adjudicate(float value, int ply, int& resignCount, int& drawCount)
+	{
+		bool whiteWinning = value <= LOW_LABEL + adjudication.resignMargin;
+		bool blackWinning = value >= HIGH_LABEL - adjudication.resignMargin;
+		resignCount = whiteWinning ? std::max(resignCount, 0) + 1 : blackWinning ? std::min(resignCount, 0) - 1 : 0;
+		drawCount = fabs(value - (HIGH_LABEL + LOW_LABEL) * 0.5f) <= adjudication.drawMargin ? drawCount + 1 : 0;
+
+		GameEnd ending = GameEnd::NONE;
+		GameResult result = GameResult::DRAW;
+		if (abs(resignCount) >= adjudication.resignPlies)
+		{
+			ending = GameEnd::RESIGNATION;
+			result = resignCount > 0 ? GameResult::WHITE_WIN : GameResult::BLACK_WIN;
+		}
+		else if (drawCount >= adjudication.drawPlies && ply >= adjudication.drawStartPly)
+		{
+			ending = GameEnd::ADJUDICATED_DRAW;
+		}
+		if (ending == GameEnd::NONE || auditing)
+		{
+			if (ending != GameEnd::NONE && !audited)
+			{
+				audited = true;
+				adjudicatedResult = result;
+			}
+			return GameEnd::NONE;
+		}
+		whiteWin = result == GameResult::WHITE_WIN;
+		blackWin = result == GameResult::BLACK_WIN;
+		return ending;
 	}
 
+	// Root of the search. The first layer accumulator is computed from scratch here and updated incrementally below.
 	AlphaBetaEvaluation BoardManager::alphaBeta(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int depth, float alpha, float beta)
 	{
+		if (!accumulator.loaded(network))
+		{
+			accumulator.load(network);
+		}
+		accumulator.refresh(boardStateData);
+		return alphaBetaSearch(boardStateData, network, depth, 0, alpha, beta);
+	}
+
+	SearchResult BoardManager::iterativeSearch(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int maxDepth, int milliseconds)
+	{
+		SearchLimits limits;
+		limits.depth = maxDepth;
+		limits.milliseconds = milliseconds;
+		return iterativeSearch(boardStateData, network, limits);
+	}
+
+	// Searches one ply deeper at a time until a limit is reached. The transposition table keeps no depth, so it is
+	// cleared before every iteration. An iteration a limit stopped is thrown away, the first one always finishes.
+	SearchResult BoardManager::iterativeSearch(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, const SearchLimits& limits)
+	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		SearchResult result;
+		searchNodes = 0;
+		searchStopped = false;
+		searchLimits = &limits;
+		searchDeadline = begin + std::chrono::milliseconds(limits.milliseconds);
+		// The accumulator keeps one entry per ply, quiescence included
+		int maxDepth = std::min(limits.depth > 0 ? limits.depth : MAX_SEARCH_PLY, MAX_SEARCH_PLY - QUIESCENCE_DEPTH - 1);
+		for (int depth = 1; depth <= maxDepth; ++depth)
+		{
+			searchLimited = depth > 1;
+			boardEvaluations.clear();
+			AlphaBetaEvaluation evaluation = alphaBeta(boardStateData, network, depth, -1000.0f, 1000.0f);
+			if (searchStopped)
+			{
+				break;
+			}
+			result.evaluation = evaluation;
+			result.depth = depth;
+			result.nodes = searchNodes;
+			result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+			principalVariation(boardStateData, evaluation.move, depth, result.pv);
+			if (limits.report)
+			{
+				limits.report(result);
+			}
+			// A mate is not going to change with depth
+			if (fabs(evaluation.evaluatedValue) >= 1000.0f)
+			{
+				break;
+			}
+			if (limits.milliseconds > 0 && std::chrono::steady_clock::now() >= searchDeadline)
+			{
+				break;
+			}
+		}
+		boardEvaluations.clear();
+		searchLimits = nullptr;
+		searchLimited = false;
+		searchStopped = false;
+		result.nodes = searchNodes;
+		result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		return result;
+	}
+
+	// Follows the best moves the transposition table holds after move, for as long as they are legal
+	void BoardManager::principalVariation(const BoardStateData& boardStateData, const MoveData& move, int depth, std::vector<MoveData>& pv)
+	{
+		pv.clear();
+		BoardStateData position;
+		position.copy(boardStateData);
+		MoveData next = move;
+		while ((int)pv.size() < depth)
+		{
+			std::vector<MoveData> moves = legalMoves(position);
+			if (std::none_of(moves.begin(), moves.end(), [&next](const MoveData& legal) { return sameMove(legal, next); }))
+			{
+				break;
+			}
+			pv.push_back(next);
+			applyMove(position, next);
+			auto entry = boardEvaluations.find(zobristHash(position));
+			if (entry == boardEvaluations.end())
+			{
+				break;
+			}
+			next = entry->second.move;
+		}
+	}
+
+	// Counts a node and tells whether the search has to give up. Nodes cost a network evaluation, so reading the
+	// clock and the stop signal every 64 of them is cheap.
+	bool BoardManager::searchOutOfTime()
+	{
+		++searchNodes;
+		if (searchLimited && !searchStopped)
+		{
+			searchStopped = (searchLimits->nodes > 0 && searchNodes >= searchLimits->nodes)
+				|| ((searchNodes & 63) == 0 && ((searchLimits->milliseconds > 0 && std::chrono::steady_clock::now() >= searchDeadline)
+					|| (searchLimits->stop != nullptr && searchLimits->stop->load(std::memory_order_relaxed))));
+		}
+		return searchStopped;
+	}
+
+	// Roughly what one transposition table entry costs in an unordered_map, node and bucket included
+	void BoardManager::setHashSize(int megabytes)
+	{
+		hashEntries = megabytes > 0 ? (size_t)megabytes * 1024 * 1024 / (sizeof(AlphaBetaEvaluation) + sizeof(unsigned long int) + 4 * sizeof(void*)) : 0;
+	}
+
+	AlphaBetaEvaluation BoardManager::alphaBetaSearch(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int depth, int ply, float alpha, float beta)
+	{
+		if (searchOutOfTime())
+		{
+			// The iteration is discarded, the value does not matter
+			return AlphaBetaEvaluation{ MoveData(), 0.0f };
+		}
 		bool savePosition = false;
 		unsigned long int zHash = zobristHash(boardStateData);
 		auto transpVal = boardEvaluations.find(zHash);
@@ -65,28 +247,41 @@ namespace BoardState
 			savePosition = true;
 		}
 
+		if (depth <= 0)
+		{
+			return quiescence(boardStateData, network, QUIESCENCE_DEPTH, ply, alpha, beta);
+		}
+
 		std::vector<MoveData> moves = genRawMoves(boardStateData);
 		std::vector<BoardStateData> newStates = filterMoves(boardStateData, moves);
 		AlphaBetaEvaluation evaluation;
+		if (ply == 0 && searchLimits != nullptr && !searchLimits->rootMoves.empty())
+		{
+			restrictRootMoves(moves, newStates);
+		}
 
 		if (moves.size() == 0)
 		{
 			evaluate(boardStateData, network, evaluation, true);
 			return evaluation;
 		}
-		if (depth <= 0)
-		{
-			evaluate(boardStateData, network, evaluation, false);
-			return evaluation;
-		}
 
+		std::vector<int> seeScores;
+		std::vector<int> order = orderMoves(boardStateData, moves, seeScores);
 		float abValue;
-		evaluation.move = moves[0];
+		evaluation.move = moves[order[0]];
 		evaluation.evaluatedValue = boardStateData._turn ? -1000.0f : 1000.0f;
 
-		for (unsigned int i = 0; i < moves.size(); ++i)
+		for (unsigned int n = 0; n < order.size(); ++n)
 		{
-			abValue = alphaBeta(newStates[i], network, depth - 1, alpha, beta).evaluatedValue;
+			int i = order[n];
+			// Late move pruning: at frontier nodes losing captures are sorted last and are not worth a search
+			if (depth == 1 && n >= LATE_MOVE_INDEX && seeScores[i] < 0)
+			{
+				break;
+			}
+			accumulator.update(ply, boardStateData, newStates[i]);
+			abValue = alphaBetaSearch(newStates[i], network, depth - 1, ply + 1, alpha, beta).evaluatedValue;
 			if (boardStateData._turn == 0)
 			{
 				if (abValue < evaluation.evaluatedValue)
@@ -110,13 +305,135 @@ namespace BoardState
 				break;
 			}
 		}
-		if (savePosition)
+		if (savePosition && (hashEntries == 0 || boardEvaluations.size() < hashEntries))
 		{
 			boardEvaluations.insert({ zHash, evaluation });
 		}
 		return evaluation;
 	}
 
+	// Keeps the legal root moves that are also in searchLimits->rootMoves, their states stay in step
+	void BoardManager::restrictRootMoves(std::vector<MoveData>& moves, std::vector<BoardStateData>& newStates)
+	{
+		unsigned int kept = 0;
+		for (unsigned int i = 0; i < moves.size(); ++i)
+		{
+			for (const MoveData& allowed : searchLimits->rootMoves)
+			{
+				if (sameMove(moves[i], allowed))
+				{
+					moves[kept] = moves[i];
+					newStates[kept++] = newStates[i];
+					break;
+				}
+			}
+		}
+		moves.resize(kept);
+		newStates.resize(kept);
+	}
+
+	// Searches captures that do not lose material until the position is quiet. The static evaluation is used as
+	// a stand pat value, so the side to move is never forced to make a capture.
+	AlphaBetaEvaluation BoardManager::quiescence(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int depth, int ply, float alpha, float beta)
+	{
+		if (searchOutOfTime())
+		{
+			return AlphaBetaEvaluation{ MoveData(), 0.0f };
+		}
+		std::vector<MoveData> moves = genRawMoves(boardStateData);
+		std::vector<BoardStateData> newStates = filterMoves(boardStateData, moves);
+		AlphaBetaEvaluation evaluation;
+
+		if (moves.size() == 0)
+		{
+			evaluate(boardStateData, network, evaluation, true);
+			return evaluation;
+		}
+		evaluation.evaluatedValue = quantizedNetwork != nullptr ? quantizedNetwork->evaluate(boardStateData, quantizedScratch) : accumulator.propagate(ply);
+		if (depth <= 0)
+		{
+			return evaluation;
+		}
+		if (boardStateData._turn == 0)
+		{
+			if (evaluation.evaluatedValue <= alpha)
+			{
+				return evaluation;
+			}
+			beta = std::min(beta, evaluation.evaluatedValue);
+		}
+		else
+		{
+			if (evaluation.evaluatedValue >= beta)
+			{
+				return evaluation;
+			}
+			alpha = std::max(alpha, evaluation.evaluatedValue);
+		}
+
+		std::vector<int> seeScores;
+		std::vector<int> order = orderMoves(boardStateData, moves, seeScores);
+		float qValue;
+		for (unsigned int n = 0; n < order.size(); ++n)
+		{
+			int i = order[n];
+			// Captures come first in the ordering, so the first quiet move or losing capture ends the search
+			if (!isCapture(boardStateData, moves[i]) || seeScores[i] < 0)
+			{
+				break;
+			}
+			accumulator.update(ply, boardStateData, newStates[i]);
+			qValue = quiescence(newStates[i], network, depth - 1, ply + 1, alpha, beta).evaluatedValue;
+			if (boardStateData._turn == 0)
+			{
+				if (qValue < evaluation.evaluatedValue)
+				{
+					evaluation.evaluatedValue = qValue;
+					evaluation.move = moves[i];
+				}
+				beta = std::min(beta, evaluation.evaluatedValue);
+			}
+			else
+			{
+				if (qValue > evaluation.evaluatedValue)
+				{
+					evaluation.evaluatedValue = qValue;
+					evaluation.move = moves[i];
+				}
+				alpha = std::max(alpha, evaluation.evaluatedValue);
+			}
+			if (alpha >= beta)
+			{
+				break;
+			}
+		}
+		return evaluation;
+	}
+
+	// Returns move indices in search order: captures that win or hold material by static exchange value, then quiet
+	// moves in generation order, then losing captures. seeScores is filled for every move and is 0 for quiet moves.
+	std::vector<int> BoardManager::orderMoves(const BoardStateData& boardStateData, const std::vector<MoveData>& moves, std::vector<int>& seeScores)
+	{
+		std::vector<int> order(moves.size());
+		std::vector<int> keys(moves.size());
+		seeScores.assign(moves.size(), 0);
+		for (unsigned int i = 0; i < moves.size(); ++i)
+		{
+			order[i] = i;
+			if (isCapture(boardStateData, moves[i]))
+			{
+				seeScores[i] = staticExchangeEvaluation(boardStateData, moves[i]);
+				keys[i] = seeScores[i] >= 0 ? seeScores[i] + 1 : seeScores[i] - 1000;
+			}
+			else
+			{
+				keys[i] = 0;
+			}
+		}
+		std::stable_sort(order.begin(), order.end(), [&keys](int a, int b) { return keys[a] > keys[b]; });
+		return order;
+	}
+
 	void BoardManager::initBoardStateDataPieces(PieceCode pieces[])
 	{
 		for (int x = 0; x < BOARD_LENGTH; ++x)
@@ -186,6 +503,7 @@ namespace BoardState
 		boardStateDate._qRookMoved[0] = false;
 		boardStateDate._qRookMoved[1] = false;
 		boardStateDate._enPassant = -1;
+		boardStateDate._halfmoveClock = 0;
 	}
 
 	void BoardManager::calculateZobristValues()
@@ -244,6 +562,17 @@ namespace BoardState
 		}
 	}
 
+	// Hashes the same positions to the same keys as other, so a worker searches with the keys of a restored checkpoint
+	void BoardManager::copyZobristValues(const BoardManager& other)
+	{
+		std::copy(std::begin(other.zobristPieceValues), std::end(other.zobristPieceValues), zobristPieceValues);
+		std::copy(std::begin(other.zobristTurnValues), std::end(other.zobristTurnValues), zobristTurnValues);
+		std::copy(std::begin(other.zobristKingMovedValues), std::end(other.zobristKingMovedValues), zobristKingMovedValues);
+		std::copy(std::begin(other.zobristQRookMovedValues), std::end(other.zobristQRookMovedValues), zobristQRookMovedValues);
+		std::copy(std::begin(other.zobristKRookMovedValues), std::end(other.zobristKRookMovedValues), zobristKRookMovedValues);
+		std::copy(std::begin(other.zobristEnPassantValues), std::end(other.zobristEnPassantValues), zobristEnPassantValues);
+	}
+
 	void BoardManager::exportANN(AnnUtilities::ANNetwork& network, std::string fileName)
 	{
 		int hiddenLayers = 0;
@@ -254,7 +583,7 @@ namespace BoardState
 			l = l->_nextLayer;
 		}
 		std::ofstream file;
-		file.open(fileName, std::ios_base::app);
+		file.open(fileName, std::ios_base::trunc);
 		file << network._inputLayer->_layerSize << "\n";
 		file << network._inputLayer->_nextLayer->_layerSize << "\n";
 		file << network._outputLayer->_layerSize << "\n";
@@ -285,72 +614,62 @@ namespace BoardState
 		file.close();
 	}
 
-	//AnnUtilities::Network BoardManager::importANN(std::string fileName)
-	//{
-		//AnnUtilities::Network ann;
-		//std::ifstream file;
-		//file.open(fileName);
-		//std::string line;
-		//std::getline(file, line);
-		//int inputSize = std::stoi(line);
-		//std::getline(file, line);
-		//int hiddenSize = std::stoi(line);
-		//std::getline(file, line);
-		//int outputSize = std::stoi(line);
-		//std::getline(file, line);
-		//int nHiddenLayers = std::stoi(line);
-
-		//_inputLayer = new ANNLayer(inputSize);
-		//_inputLayer._previousLayer = null;
-		//ANNLayer[] hiddenLayers = new ANNLayer[nHiddenLayers];
-		//hiddenLayers[0] = new ANNLayer(hiddenSize);
-		//hiddenLayers[0]._previousLayer = _inputLayer;
-		//for (int i = 1; i < nHiddenLayers; ++i)
-		//{
-		//	hiddenLayers[i] = new ANNLayer(hiddenSize, hiddenLayers[i - 1]);
-		//	hiddenLayers[i - 1]._nextLayer = hiddenLayers[i];
-		//}
-		//_outputLayer = new ANNLayer(outputSize, hiddenLayers[hiddenLayers.Length - 1]);
-		//_outputLayer._nextLayer = null;
-		//hiddenLayers[hiddenLayers.Length - 1] = _outputLayer;
-
-		//ANNLayer l = _inputLayer._nextLayer;
-		//for (int i = 0; i < hiddenSize; ++i)
-		//{
-		//	for (int j = 0; j < inputSize; ++j)
-		//	{
-		//		l._weights[i * inputSize + j] = float.Parse(lines[++line]);
-		//	}
-		//}
-		//l = l._nextLayer;
-		//while (l != _outputLayer)
-		//{
-		//	for (int i = 0; i < hiddenSize; ++i)
-		//	{
-		//		for (int j = 0; j < hiddenSize; ++j)
-		//		{
-		//			l._weights[i * hiddenSize + j] = float.Parse(lines[++line]);
-		//		}
-		//	}
-		//	l = l._nextLayer;
-		//}
-		//for (int i = 0; i < outputSize; ++i)
-		//{
-		//	for (int j = 0; j < hiddenSize; ++j)
-		//	{
-		//		_outputLayer._weights[i * hiddenSize + j] = float.Parse(lines[++line]);
-		//	}
-		//}
-		//l = _inputLayer._nextLayer;
-		//while (l != null)
-		//{
-		//	for (int i = 0; i < l._layerSize; ++i)
-		//	{
-		//		l._biases[i] = float.Parse(lines[++line]);
-		//	}
-		//	l = l._nextLayer;
-		//}
-	//}
+	// Binary model, see ModelFile.h
+	void BoardManager::exportModel(const AnnUtilities::ANNetwork& network, std::string fileName)
+	{
+		AnnUtilities::NetworkArena arena;
+		arena.allocate(network._settings, AnnUtilities::ArenaContents::PARAMETERS, 0, false);
+		arena.load(network);
+		arena.writeModel(fileName, syncPolicy);
+	}
+
+	// Copies the parameters into a recycled buffer and leaves the checksum and the write to the snapshot thread
+	void BoardManager::snapshotModel(const AnnUtilities::ANNetwork& network, std::string fileName)
+	{
+		std::vector<char> image = snapshotWriter.acquire();
+		if (&network == trainedNetwork)
+		{
+			trainer.parameters().modelImage(image);
+		}
+		else
+		{
+			AnnUtilities::NetworkArena arena;
+			arena.allocate(network._settings, AnnUtilities::ArenaContents::PARAMETERS, 0, false);
+			arena.load(network);
+			arena.modelImage(image);
+		}
+		snapshotWriter.submit(fileName, std::move(image), &AnnUtilities::sealModelImage);
+	}
+
+	void BoardManager::flushSnapshots()
+	{
+		snapshotWriter.flush();
+	}
+
+	void BoardManager::setSyncPolicy(AnnUtilities::SyncPolicy policy)
+	{
+		syncPolicy = policy;
+		snapshotWriter.setSyncPolicy(policy);
+	}
+
+	// Rebuilds network with the topology and weights of a binary model, its learning rate and momentum are kept
+	void BoardManager::importANN(AnnUtilities::ANNetwork& network, std::string fileName)
+	{
+		AnnUtilities::NetworkArena arena;
+		arena.mapModel(fileName);
+		AnnUtilities::ANNSettings settings = arena.networkSettings();
+		settings._learningRate = network._settings._learningRate;
+		settings._momentum = network._settings._momentum;
+		network.Clean();
+		network._settings = settings;
+		network.Init();
+		arena.store(network);
+		if (&network == trainedNetwork)
+		{
+			trainedNetwork = nullptr;
+		}
+		accumulator.invalidate();
+	}
 
 	void BoardManager::placePiece(PieceCode pieces[], PieceCode pieceCode, int x, int y)
 	{
@@ -361,38 +680,99 @@ namespace BoardState
 	{
 		if (noMoves)
 		{
-			if (boardStateData._turn)
+			evaluation.move.xStart = -1;
+			// Stalemate is a draw, only a side in check without moves is mated
+			if (!inCheck(boardStateData))
+			{
+				evaluation.evaluatedValue = (LOW_LABEL + HIGH_LABEL) * 0.5f;
+			}
+			else if (boardStateData._turn)
 			{
 				evaluation.evaluatedValue = -1000.0f;
-				evaluation.move.xStart = -1;
 			}
 			else
 			{
 				evaluation.evaluatedValue = 1000.0f;
-				evaluation.move.xStart = -1;
 			}
 		}
+		else if (quantizedNetwork != nullptr)
+		{
+			evaluation.evaluatedValue = quantizedNetwork->evaluate(boardStateData, quantizedScratch);
+		}
 		else
 		{
-			setANNInput(boardStateData, network._inputLayer);
-			network.propagateForward();
-			evaluation.evaluatedValue = network._outputLayer->getOutput()[0];
+			if (!accumulator.loaded(network))
+			{
+				accumulator.load(network);
+			}
+			evaluation.evaluatedValue = accumulator.evaluate(boardStateData);
 		}
 	}
 
-	void BoardManager::train(AnnUtilities::ANNetwork& ann)
+	// Static evaluations use the quantized network while one is set, nullptr goes back to the float network
+	void BoardManager::setQuantizedNetwork(const QuantizedNetwork* network)
+	{
+		quantizedNetwork = network;
+	}
+
+	// Positions from games of uniformly random legal moves, a game is restarted when it ends or gets long
+	std::vector<BoardStateData> BoardManager::samplePositions(int count, unsigned int seed)
+	{
+		std::mt19937 e2(seed);
+		std::vector<BoardStateData> positions;
+		BoardStateData boardStateData;
+		resetBoardStateData(boardStateData);
+		int plies = 0;
+		while ((int)positions.size() < count)
+		{
+			std::vector<MoveData> moves = genRawMoves(boardStateData);
+			std::vector<BoardStateData> newStates = filterMoves(boardStateData, moves);
+			if (newStates.size() == 0 || plies >= 200)
+			{
+				resetBoardStateData(boardStateData);
+				plies = 0;
+				continue;
+			}
+			std::uniform_int_distribution<int> dist(0, (int)newStates.size() - 1);
+			boardStateData.copy(newStates[dist(e2)]);
+			positions.push_back(boardStateData);
+			++plies;
+		}
+		return positions;
+	}
+
+	// Moves and result of the game that was just played, the move history is left empty
+	PlayedGame BoardManager::finishGame()
+	{
+		PlayedGame game;
+		game.start = gameStart;
+		while (!alphaBetaHistory.empty())
+		{
+			game.moves.push_back(alphaBetaHistory.front().move);
+			game.values.push_back(alphaBetaHistory.front().evaluatedValue);
+			alphaBetaHistory.pop();
+		}
+		game.whiteWin = whiteWin;
+		game.blackWin = blackWin;
+		game.ending = gameEnd;
+		game.audited = audited;
+		game.adjudicatedResult = adjudicatedResult;
+		return game;
+	}
+
+	// Replays a game into the replay buffer with labels that ramp from a draw at the first move to the result at the last
+	void BoardManager::addGame(const PlayedGame& game)
 	{
 		float label;
 		float slope;
 		float average = (HIGH_LABEL + LOW_LABEL) * 0.5f;
-		int size = alphaBetaHistory.size();
-		BoardStateData boardStateData;
-		resetBoardStateData(boardStateData);
-		if (whiteWin)
+		int size = game.moves.size();
+		BoardStateData boardStateData = game.start;
+		if (game.whiteWin)
 		{
 			label = LOW_LABEL;
 		}
-		else if (blackWin)
+		else if (game.blackWin)
 		{
 			label = HIGH_LABEL;
 		}
@@ -401,16 +781,103 @@ namespace BoardState
 			label = average;
 		}
 		slope = (label - average) / size;
+		initReplayBuffer();
 		for (int i = 0; i < size; ++i)
 		{
-			label = slope * i + average;
-			playMove(boardStateData, alphaBetaHistory.front().move);
-			setANNInput(boardStateData, ann._inputLayer);
-			ann.propagateForward();
-			ann.propagateBackward(&label);
-			alphaBetaHistory.pop();
+			playMove(boardStateData, game.moves[i]);
+			replayBuffer.add(boardStateData, slope * i + average);
 		}
-		ann.update(size, 0.2f);
+	}
+
+	// A single position with a label of its own, e.g. from an EPD file
+	void BoardManager::addPosition(const BoardStateData& boardStateData, float label)
+	{
+		initReplayBuffer();
+		replayBuffer.add(boardStateData, label);
+	}
+
+	void BoardManager::initReplayBuffer()
+	{
+		if (replayBuffer.capacity() == 0)
+		{
+			std::random_device rd;
+			replayBuffer.init(REPLAY_CAPACITY, rd());
+		}
+	}
+
+	// Trains mini-batches sampled from the replay buffer on the trainer's copy of the network. Returns the number of
+	// batches trained, 0 when the buffer is empty.
+	int BoardManager::trainReplay(AnnUtilities::ANNetwork& ann, int batches)
+	{
+		if (replayBuffer.empty() || batches <= 0)
+		{
+			return 0;
+		}
+
+		std::vector<BoardStateData> positions;
+		std::vector<TrainingSample> samples;
+		std::vector<int> indices;
+		std::vector<float> errors(trainer.getBatchSize());
+		trainer.load(ann);
+		for (int i = 0; i < batches; ++i)
+		{
+			replayBuffer.sample(trainer.getBatchSize(), replaySampling, positions, samples, indices);
+			trainer.trainBatch(&samples[0], (int)samples.size(), 0.2f, &errors[0]);
+			if (replaySampling == ReplaySampling::PRIORITIZED)
+			{
+				replayBuffer.updatePriorities(indices, &errors[0], (int)samples.size());
+			}
+		}
+		trainer.store(ann);
+		trainedNetwork = &ann;
+		accumulator.invalidate();
+		return batches;
+	}
+
+	// Trains on the game this manager just played
+	void BoardManager::train(AnnUtilities::ANNetwork& ann)
+	{
+		addGame(finishGame());
+		trainReplay(ann, replayBatchesPerGame);
+	}
+
+	// Searches with weights that other managers share instead of a private copy of network. The weights have to be
+	// shared again after network changes.
+	void BoardManager::shareNetwork(const AnnUtilities::ANNetwork& network, std::shared_ptr<const AnnUtilities::InferenceNetwork> shared)
+	{
+		accumulator.attach(network, shared);
+	}
+
+	void BoardManager::setVerbose(bool printGames)
+	{
+		verbose = printGames;
+	}
+
+	void BoardManager::setAdjudication(const AdjudicationSettings& settings)
+	{
+		adjudication = settings;
+	}
+
+	// Plays the next games to the end whatever adjudication says, set per game by whoever schedules them
+	void BoardManager::auditNextGame(bool audit)
+	{
+		auditing = audit;
+	}
+
+	void BoardManager::setReplaySampling(ReplaySampling mode, int batchesPerGame)
+	{
+		replaySampling = mode;
+		replayBatchesPerGame = batchesPerGame;
+	}
+
+	void BoardManager::setTrainingBatchSize(int size)
+	{
+		trainer.setBatchSize(size);
+	}
+
+	void BoardManager::setTrainingThreads(int count)
+	{
+		trainer.setThreads(count);
 	}
 
 	void BoardManager::setANNInput(const BoardStateData& boardStateData, AnnUtilities::Layer* inputLayer)
@@ -597,6 +1064,13 @@ namespace BoardState
 		return h;
 	}
 
+	bool BoardManager::inCheck(const BoardStateData& boardStateData)
+	{
+		int kingPos[2] = { 0, 0 };
+		findKing(boardStateData._pieces, boardStateData._turn, kingPos);
+		return squareThreatened(boardStateData._pieces, boardStateData._turn, kingPos[0], kingPos[1]);
+	}
+
 	void BoardManager::findKing(const PieceCode pieces[], bool turn, int* pos)
 	{
 		PieceCode king = turn ? PieceCode::B_KING : PieceCode::W_KING;
@@ -621,6 +1095,15 @@ namespace BoardState
 
 	void BoardManager::playMove(BoardStateData& boardStateData, const MoveData& move)
 	{
+		applyMove(boardStateData, move);
+	}
+
+	// Plays a move that was generated for the position, needs nothing else from a manager
+	void applyMove(BoardStateData& boardStateData, const MoveData& move)
+	{
+		PieceCode moved = move.xStart < 0 ? PieceCode::EMPTY : boardStateData._pieces[move.yStart * BOARD_LENGTH + move.xStart];
+		bool capture = move.enPassant || (move.xEnd >= 0 && boardStateData._pieces[move.yEnd * BOARD_LENGTH + move.xEnd] != PieceCode::EMPTY);
+		boardStateData._halfmoveClock = capture || moved == PieceCode::W_PAWN || moved == PieceCode::B_PAWN ? 0 : boardStateData._halfmoveClock + 1;
 		boardStateData._enPassant = -1;
 		if (move.enPassant)
 		{
@@ -678,6 +1161,56 @@ namespace BoardState
 		boardStateData._turn = !boardStateData._turn;
 	}
 
+	bool sameMove(const MoveData& a, const MoveData& b)
+	{
+		return a.shortCastle == b.shortCastle && a.longCastle == b.longCastle && a.upgrade == b.upgrade
+			&& a.xStart == b.xStart && a.yStart == b.yStart && a.xEnd == b.xEnd && a.yEnd == b.yEnd;
+	}
+
+	bool insufficientMaterial(const BoardStateData& boardStateData)
+	{
+		int minors = 0;
+		int bishopSquares[2] = { 0, 0 };
+		for (int i = 0; i < BOARD_LENGTH * BOARD_LENGTH; ++i)
+		{
+			switch (boardStateData._pieces[i])
+			{
+			case PieceCode::EMPTY:
+			case PieceCode::W_KING:
+			case PieceCode::B_KING:
+				break;
+			case PieceCode::W_BISHOP:
+			case PieceCode::B_BISHOP:
+				++minors;
+				++bishopSquares[(i / BOARD_LENGTH + i % BOARD_LENGTH) % 2];
+				break;
+			case PieceCode::W_KNIGHT:
+			case PieceCode::B_KNIGHT:
+				++minors;
+				break;
+			default:
+				return false;
+			}
+		}
+		return minors <= 1 || (bishopSquares[0] == minors || bishopSquares[1] == minors);
+	}
+
+	const char* gameEndName(GameEnd ending)
+	{
+		switch (ending)
+		{
+		case GameEnd::CHECKMATE: return "checkmate";
+		case GameEnd::STALEMATE: return "stalemate";
+		case GameEnd::REPETITION: return "repetition";
+		case GameEnd::FIFTY_MOVES: return "fifty-move rule";
+		case GameEnd::INSUFFICIENT_MATERIAL: return "insufficient material";
+		case GameEnd::MAX_TURNS: return "move limit";
+		case GameEnd::RESIGNATION: return "resignation";
+		case GameEnd::ADJUDICATED_DRAW: return "draw adjudication";
+		default: return "unknown";
+		}
+	}
+
 	void BoardManager::reset()
 	{
 		for (unsigned int i = 0; i < alphaBetaHistory.size(); ++i)
@@ -690,8 +1223,11 @@ namespace BoardState
 		}
 		hashPositions.clear();
 		boardEvaluations.clear();
+		mctsTree.clear();
 		whiteWin = false;
 		blackWin = false;
+		gameEnd = GameEnd::NONE;
+		audited = false;
 	}
 
 	bool BoardManager::zobristValueExists(unsigned long int v)
@@ -729,24 +1265,27 @@ namespace BoardState
 		return false;
 	}
 
-	void BoardManager::checkWinner(const BoardStateData& boardStateData)
+	GameEnd BoardManager::checkWinner(const BoardStateData& boardStateData)
 	{
-		PieceCode king = boardStateData._turn ? PieceCode::B_KING : PieceCode::W_KING;
-		int kingCoord[2];
-		findKing(boardStateData._pieces, boardStateData._turn, kingCoord);
 		std::vector<MoveData> moves = genRawMoves(boardStateData);
 		filterMoves(boardStateData, moves);
-		if (moves.size() == 0)
+		if (moves.size() != 0)
 		{
-			if (boardStateData._turn == 0)
-			{
-				blackWin = true;
-			}
-			else
-			{
-				whiteWin = true;
-			}
+			return GameEnd::NONE;
 		}
+		if (!inCheck(boardStateData))
+		{
+			return GameEnd::STALEMATE;
+		}
+		if (boardStateData._turn == 0)
+		{
+			blackWin = true;
+		}
+		else
+		{
+			whiteWin = true;
+		}
+		return GameEnd::CHECKMATE;
 	}
 
 	void BoardManager::printBoard(const BoardStateData& boardStateData) const
@@ -819,6 +1358,14 @@ namespace BoardState
 		}
 	}
 
+	// The moves of the side to move that do not leave its own king in check
+	std::vector<MoveData> BoardManager::legalMoves(const BoardStateData& boardStateData)
+	{
+		std::vector<MoveData> moves = genRawMoves(boardStateData);
+		filterMoves(boardStateData, moves);
+		return moves;
+	}
+
 	std::vector<MoveData> BoardManager::genRawMoves(const BoardStateData& boardStateData)
 	{
 		std::vector<MoveData> moves;
@@ -1344,6 +1891,100 @@ namespace BoardState
 		return false;
 	}
 
+	int BoardManager::pieceValue(PieceCode piece)
+	{
+		switch (piece)
+		{
+		case PieceCode::W_PAWN: case PieceCode::B_PAWN:
+			return 100;
+		case PieceCode::W_KNIGHT: case PieceCode::B_KNIGHT:
+			return 300;
+		case PieceCode::W_BISHOP: case PieceCode::B_BISHOP:
+			return 300;
+		case PieceCode::W_ROOK: case PieceCode::B_ROOK:
+			return 500;
+		case PieceCode::W_QUEEN: case PieceCode::B_QUEEN:
+			return 900;
+		case PieceCode::W_KING: case PieceCode::B_KING:
+			return 10000;
+		default:
+			return 0;
+		}
+	}
+
+	bool BoardManager::isCapture(const BoardStateData& boardStateData, const MoveData& move)
+	{
+		return move.enPassant
+			|| (!move.shortCastle && !move.longCastle && boardStateData._pieces[move.yEnd * BOARD_LENGTH + move.xEnd] != PieceCode::EMPTY);
+	}
+
+	bool BoardManager::leastValuableAttacker(const PieceCode pieces[], bool side, int x, int y, int* pos)
+	{
+		int bestValue = 0;
+		for (int yBoard = 0; yBoard < BOARD_LENGTH; ++yBoard)
+		{
+			for (int xBoard = 0; xBoard < BOARD_LENGTH; ++xBoard)
+			{
+				PieceCode piece = pieces[yBoard * BOARD_LENGTH + xBoard];
+				if (piece != PieceCode::EMPTY
+					&& ((int)piece >> (PIECE_CODE_LENGTH - 1)) == side
+					&& (bestValue == 0 || pieceValue(piece) < bestValue)
+					&& pieceCanThreatenSquare(pieces, piece, !side, xBoard, yBoard, x, y))
+				{
+					bestValue = pieceValue(piece);
+					pos[0] = xBoard;
+					pos[1] = yBoard;
+				}
+			}
+		}
+		return bestValue != 0;
+	}
+
+	// Material balance in centipawns of the capture sequence on the move's target square, assuming both sides
+	// always recapture with their least valuable attacker and may stop capturing when it stops paying off.
+	// Attackers are removed from a scratch board one by one, so x-ray attackers behind them are found by the scan.
+	int BoardManager::staticExchangeEvaluation(const BoardStateData& boardStateData, const MoveData& move)
+	{
+		int captured[32];
+		int n = 0;
+		int attackerPos[2];
+		PieceCode pieces[BOARD_LENGTH * BOARD_LENGTH];
+		std::copy(boardStateData._pieces, boardStateData._pieces + BOARD_LENGTH * BOARD_LENGTH, pieces);
+
+		int target = move.yEnd * BOARD_LENGTH + move.xEnd;
+		PieceCode mover = pieces[move.yStart * BOARD_LENGTH + move.xStart];
+		captured[n] = move.enPassant ? pieceValue(PieceCode::W_PAWN) : pieceValue(pieces[target]);
+		if (move.upgrade != PieceCode::EMPTY)
+		{
+			captured[n] += pieceValue(move.upgrade) - pieceValue(mover);
+			mover = move.upgrade;
+		}
+		++n;
+		if (move.enPassant)
+		{
+			pieces[move.yStart * BOARD_LENGTH + move.xEnd] = PieceCode::EMPTY;
+		}
+		pieces[target] = mover;
+		pieces[move.yStart * BOARD_LENGTH + move.xStart] = PieceCode::EMPTY;
+
+		bool side = !boardStateData._turn;
+		while (n < 32 && leastValuableAttacker(pieces, side, move.xEnd, move.yEnd, attackerPos))
+		{
+			captured[n++] = pieceValue(pieces[target]);
+			pieces[target] = pieces[attackerPos[1] * BOARD_LENGTH + attackerPos[0]];
+			pieces[attackerPos[1] * BOARD_LENGTH + attackerPos[0]] = PieceCode::EMPTY;
+			side = !side;
+		}
+
+		// Every recapture is optional, the first capture is the move itself
+		int score = 0;
+		for (int i = n - 1; i > 0; --i)
+		{
+			score = std::max(0, captured[i] - score);
+		}
+		return captured[0] - score;
+	}
+
 	bool BoardManager::moveIsLegal(const BoardStateData& boardStateData, const MoveData move)
 	{
 		if (move.xStart < 0 || move.xStart >= BOARD_LENGTH || move.yStart < 0 || move.yStart >= BOARD_LENGTH
@@ -1,13 +1,26 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <ANNetwork.h>
 #include <Layer.h>
 #include <queue>
 #include <unordered_map>
 #include <string>
+#include <chrono>
+#include <atomic>
+#include <functional>
 #include "PieceCode.h"
 #include "MoveData.h"
+#include "Mcts.h"
+#include "Accumulator.h"
+#include "QuantizedNetwork.h"
+#include "Trainer.h"
+#include "ReplayBuffer.h"
+#include "SnapshotWriter.h"
+
+#define HIGH_LABEL 1.0f
+#define LOW_LABEL 0.0f
 
 enum class PieceCode;
 
@@ -20,6 +33,10 @@ namespace BoardState
 		+ 2 // white castles possible
 		+ 2 // black castles possible
 		+ 8; // en passant column
+	static const int QUIESCENCE_DEPTH = 4;
+	static const int LATE_MOVE_INDEX = 8;
+	// Plies without a capture or pawn move that draw a game
+	static const int FIFTY_MOVE_PLIES = 100;
 
 	struct BoardStateData
 	{
@@ -29,6 +46,8 @@ namespace BoardState
 		bool _kRookMoved[2] = { false, false };
 		bool _qRookMoved[2] = { false, false };
 		int _enPassant = -1;
+		// Plies since the last capture or pawn move
+		int _halfmoveClock = 0;
 
 		void copy(const BoardStateData& rhs)
 		{
@@ -41,6 +60,7 @@ namespace BoardState
 			}
 			_turn = rhs._turn;
 			_enPassant = rhs._enPassant;
+			_halfmoveClock = rhs._halfmoveClock;
 			_kingMoved[0] = rhs._kingMoved[0];
 			_kingMoved[1] = rhs._kingMoved[1];
 			_kRookMoved[0] = rhs._kRookMoved[0];
@@ -75,8 +95,111 @@ namespace BoardState
 		float evaluatedValue;
 	};
 
+	// Outcome of an iterative deepening search. depth is the deepest iteration that finished, nodes counts the
+	// positions of all iterations. pv starts with the best move and follows the transposition table from there.
+	struct SearchResult
+	{
+		AlphaBetaEvaluation evaluation;
+		int depth = 0;
+		long long nodes = 0;
+		double milliseconds = 0.0;
+		std::vector<MoveData> pv;
+	};
+
+	// Limits of an iterative deepening search, 0 means no limit. The search also gives up once stop is set. When
+	// rootMoves is not empty only those moves are searched at the root. report is called after every finished iteration.
+	struct SearchLimits
+	{
+		int depth = 0;
+		int milliseconds = 0;
+		long long nodes = 0;
+		const std::atomic<bool>* stop = nullptr;
+		std::vector<MoveData> rootMoves;
+		std::function<void(const SearchResult&)> report;
+	};
+
+	enum class SearchMode
+	{
+		ALPHA_BETA,
+		MCTS
+	};
+
+	struct MctsLeaf
+	{
+		int node = -1;
+		bool collision = false;
+		bool terminal = false;
+		// No legal moves and in check, without moves and not in check the leaf is a stalemate
+		bool mated = false;
+		BoardStateData state;
+		std::vector<int> path;
+		std::vector<MoveData> moves;
+		std::vector<unsigned long int> childHashes;
+		float value = 0.0f;
+	};
+
+	void applyMove								(BoardStateData& boardStateData, const MoveData& move);
+	bool sameMove								(const MoveData& a, const MoveData& b);
+	// No sequence of legal moves can mate: only kings, or a single minor piece, or bishops that are all on one colour
+	bool insufficientMaterial					(const BoardStateData& boardStateData);
+
+	enum class GameResult : uint8_t
+	{
+		DRAW = 0,
+		WHITE_WIN = 1,
+		BLACK_WIN = 2
+	};
+
+	enum class GameEnd : uint8_t
+	{
+		NONE = 0,
+		CHECKMATE,
+		STALEMATE,
+		REPETITION,
+		FIFTY_MOVES,
+		INSUFFICIENT_MATERIAL,
+		MAX_TURNS,
+		RESIGNATION,
+		ADJUDICATED_DRAW
+	};
+
+	const char* gameEndName						(GameEnd ending);
+
+	// Ends self-play games the search has already decided. A side resigns after resignPlies consecutive search values
+	// within resignMargin of its loss, and a game is drawn after drawPlies consecutive values within drawMargin of
+	// 0.5 once drawStartPly plies have been played. Every auditInterval-th game is played on to the end instead, to
+	// count how often adjudication would have given the wrong result.
+	struct AdjudicationSettings
+	{
+		bool enabled = false;
+		float resignMargin = 0.02f;
+		int resignPlies = 8;
+		float drawMargin = 0.03f;
+		int drawPlies = 20;
+		int drawStartPly = 160;
+		int auditInterval = 10;
+	};
+
+	// A finished self-play game, enough to replay it into the replay buffer. values holds the search value of every move.
+	struct PlayedGame
+	{
+		int index = 0;
+		BoardStateData start;
+		std::vector<MoveData> moves;
+		std::vector<float> values;
+		bool whiteWin = false;
+		bool blackWin = false;
+		GameEnd ending = GameEnd::NONE;
+		// An audited game was played on after adjudication would have ended it with adjudicatedResult
+		bool audited = false;
+		GameResult adjudicatedResult = GameResult::DRAW;
+	};
+
 	class BoardManager
 	{
+		// Times the private hot paths, see Benchmarks/MicroBenchmarks.cpp
+		friend class MicroBenchmarks;
+
 	private:
 		unsigned long int zobristPieceValues[BOARD_LENGTH * BOARD_LENGTH * 12] = { 0 };
 		unsigned long int zobristTurnValues[2] = { 0 };
@@ -87,9 +210,37 @@ namespace BoardState
 		std::queue<AlphaBetaEvaluation> alphaBetaHistory;
 		std::unordered_map<unsigned long int, int> hashPositions;
 		std::unordered_map<unsigned long int, AlphaBetaEvaluation> boardEvaluations;
+		MctsTree mctsTree;
+		Accumulator accumulator;
+		const QuantizedNetwork* quantizedNetwork = nullptr;
+		QuantizedScratch quantizedScratch;
+		Trainer trainer;
+		ReplayBuffer replayBuffer;
+		ReplaySampling replaySampling = ReplaySampling::UNIFORM;
+		int replayBatchesPerGame = REPLAY_BATCHES_PER_GAME;
+		// The network the trainer's arena was last loaded from or stored to, its parameters can be copied from there
+		const AnnUtilities::ANNetwork* trainedNetwork = nullptr;
+		AnnUtilities::SnapshotWriter snapshotWriter;
+		AnnUtilities::SyncPolicy syncPolicy = AnnUtilities::SyncPolicy::DIRECTORY;
+		SearchMode searchMode = SearchMode::ALPHA_BETA;
+		int mctsPlayouts = 800;
 		int availableThreads = 0;
 		bool whiteWin = false;
 		bool blackWin = false;
+		bool verbose = true;
+		BoardStateData gameStart;
+		GameEnd gameEnd = GameEnd::NONE;
+		AdjudicationSettings adjudication;
+		bool auditing = false;
+		bool audited = false;
+		GameResult adjudicatedResult = GameResult::DRAW;
+		long long searchNodes = 0;
+		const SearchLimits* searchLimits = nullptr;
+		bool searchLimited = false;
+		bool searchStopped = false;
+		// Positions the transposition table may hold, 0 means no limit
+		size_t hashEntries = 0;
+		std::chrono::steady_clock::time_point searchDeadline;
 
 		void setANNInput						(const BoardStateData& boardStateData, AnnUtilities::Layer* inputLayer);
 		int positionAppeared					(const BoardStateData& boardStateData);
@@ -98,7 +249,8 @@ namespace BoardState
 		std::vector<BoardStateData> filterMoves	(const BoardStateData& boardStateData, std::vector<MoveData>& moves);
 		unsigned long int zobristHash			(const BoardStateData& boardStateData);
 		bool zobristValueExists					(unsigned long int v);
-		void checkWinner						(const BoardStateData& boardStateData);
+		GameEnd checkWinner						(const BoardStateData& boardStateData);
+		GameEnd adjudicate						(float value, int ply, int& resignCount, int& drawCount);
 		void printBoard							(const BoardStateData& boardStateData) const;
 
 		std::vector<MoveData> genRawMoves		(const BoardStateData& boardStateData);
@@ -123,6 +275,24 @@ namespace BoardState
 		bool rookCanThreatenSquare				(const PieceCode pieces[], int pieceX, int pieceY, int targetX, int targetY);
 		bool pawnCanThreatenSquare				(int turn, int pieceX, int pieceY, int targetX, int targetY);
 
+		int pieceValue							(PieceCode piece);
+		bool isCapture							(const BoardStateData& boardStateData, const MoveData& move);
+		bool leastValuableAttacker				(const PieceCode pieces[], bool side, int x, int y, int* pos);
+		int staticExchangeEvaluation			(const BoardStateData& boardStateData, const MoveData& move);
+		std::vector<int> orderMoves				(const BoardStateData& boardStateData, const std::vector<MoveData>& moves, std::vector<int>& seeScores);
+		AlphaBetaEvaluation alphaBetaSearch		(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int depth, int ply, float alpha, float beta);
+		AlphaBetaEvaluation quiescence			(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int depth, int ply, float alpha, float beta);
+		bool searchOutOfTime					();
+		void restrictRootMoves					(std::vector<MoveData>& moves, std::vector<BoardStateData>& newStates);
+		void principalVariation					(const BoardStateData& boardStateData, const MoveData& move, int depth, std::vector<MoveData>& pv);
+
+		int mctsSelectChild						(int node);
+		void mctsSelect							(MctsLeaf& leaf);
+		void mctsGenerate						(MctsLeaf& leaf);
+		void mctsExpand							(const MctsLeaf& leaf);
+		void mctsEvaluateBatch					(std::vector<MctsLeaf>& batch, const AnnUtilities::InferenceNetwork& weights, EvaluationScratch& scratch, QuantizedScratch& quantized) const;
+		void mctsBackup							(const MctsLeaf& leaf);
+
 		bool moveIsLegal						(const BoardStateData& boardStateData, const MoveData move);
 		bool moveIsLegalKing					(const MoveData& move, const PieceCode pieces[], bool turn, const bool kingMoved[], const bool kRookMoved[], const bool qRookMoved[]);
 		bool moveIsLegalQueen					(const MoveData& move, const PieceCode pieces[], bool turn);
@@ -132,17 +302,53 @@ namespace BoardState
 		bool moveIsLegalPawn					(const MoveData& move, const PieceCode pieces[], bool turn, int enPassant);
 		bool squaresAreEmpty					(const PieceCode pieces[], int xStart, int yStart, int xEnd, int yEnd);
 
+		void writeCheckpoint					(std::ostream& out, const AnnUtilities::ANNetwork& network, int games);
+		void initReplayBuffer					();
+
 	public:
 		void train								(AnnUtilities::ANNetwork& ann);
+		PlayedGame finishGame					();
+		void addGame							(const PlayedGame& game);
+		void addPosition						(const BoardStateData& boardStateData, float label);
+		int trainReplay							(AnnUtilities::ANNetwork& ann, int batches);
+		int replayBatches						() const { return replayBatchesPerGame; }
+		int replaySize							() const { return replayBuffer.size(); }
+		void shareNetwork						(const AnnUtilities::ANNetwork& network, std::shared_ptr<const AnnUtilities::InferenceNetwork> shared);
+		void setVerbose							(bool printGames);
+		void setAdjudication					(const AdjudicationSettings& settings);
+		void auditNextGame						(bool audit);
 		void process							(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int evaluationDepth, int maxTurns);
 		void evaluate							(const BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, AlphaBetaEvaluation& eval, bool noMoves);
 		void initBoardStateDataPieces			(PieceCode pieces[]);
 		void placePiece							(PieceCode pieces[], PieceCode pieceCode, int x, int y);
+		std::vector<MoveData> legalMoves		(const BoardStateData& boardStateData);
+		bool parseSan							(const BoardStateData& boardStateData, const std::string& san, MoveData& move);
+		bool inCheck							(const BoardStateData& boardStateData);
 		AlphaBetaEvaluation alphaBeta			(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int depth, float alpha, float beta);
+		AlphaBetaEvaluation mcts				(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int playouts);
+		SearchResult mcts						(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, const SearchLimits& limits);
+		SearchResult iterativeSearch			(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int maxDepth, int milliseconds);
+		SearchResult iterativeSearch			(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, const SearchLimits& limits);
+		void setHashSize						(int megabytes);
+		void setSearchMode						(SearchMode mode, int playouts);
+		void setSearchThreads					(int threads);
+		void setQuantizedNetwork				(const QuantizedNetwork* network);
+		void setTrainingBatchSize				(int size);
+		void setTrainingThreads					(int count);
+		void setReplaySampling					(ReplaySampling mode, int batchesPerGame);
+		std::vector<BoardStateData> samplePositions	(int count, unsigned int seed);
 		void reset								();
 		void resetBoardStateData				(BoardStateData& boardStateDate);
 		void calculateZobristValues				();
+		void copyZobristValues					(const BoardManager& other);
 		void exportANN							(AnnUtilities::ANNetwork& network, std::string fileName);
-		//AnnUtilities::Network importANN			(std::string fileName);
+		void exportModel						(const AnnUtilities::ANNetwork& network, std::string fileName);
+		void importANN							(AnnUtilities::ANNetwork& network, std::string fileName);
+		void saveCheckpoint						(const AnnUtilities::ANNetwork& network, int games, std::string fileName);
+		int loadCheckpoint						(AnnUtilities::ANNetwork& network, std::string fileName);
+		void snapshotModel						(const AnnUtilities::ANNetwork& network, std::string fileName);
+		void snapshotCheckpoint					(const AnnUtilities::ANNetwork& network, int games, std::string fileName);
+		void flushSnapshots						();
+		void setSyncPolicy						(AnnUtilities::SyncPolicy policy);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "Checkpoint.h"
+#include "BoardState.h"
+#include <fstream>
+#include <cstring>
+#include <ostream>
+
+namespace BoardState
+{
+	static void writeSettings(std::ostream& out, const AnnUtilities::ANNSettings& settings)
+	{
+		checkpointWrite(out, (int32_t)settings._hiddenActicationFunction);
+		checkpointWrite(out, (int32_t)settings._outputActicationFunction);
+		checkpointWrite(out, (int32_t)settings._inputSize);
+		checkpointWrite(out, (int32_t)settings._outputSize);
+		checkpointWrite(out, (int32_t)settings._hiddenSize);
+		checkpointWrite(out, (int32_t)settings._numberOfHiddenLayers);
+		checkpointWrite(out, settings._learningRate);
+		checkpointWrite(out, settings._momentum);
+	}
+
+	static AnnUtilities::ANNSettings readSettings(std::istream& in)
+	{
+		AnnUtilities::ANNSettings settings;
+		settings._hiddenActicationFunction = (AnnUtilities::ACTFUNC)checkpointRead<int32_t>(in);
+		settings._outputActicationFunction = (AnnUtilities::ACTFUNC)checkpointRead<int32_t>(in);
+		settings._inputSize = checkpointRead<int32_t>(in);
+		settings._outputSize = checkpointRead<int32_t>(in);
+		settings._hiddenSize = checkpointRead<int32_t>(in);
+		settings._numberOfHiddenLayers = checkpointRead<int32_t>(in);
+		settings._learningRate = checkpointRead<float>(in);
+		settings._momentum = checkpointRead<float>(in);
+		return settings;
+	}
+
+	// Has to be called between games, after train and reset. The network is written through the trainer, which holds
+	// the momentum that goes with its weights.
+	void BoardManager::writeCheckpoint(std::ostream& out, const AnnUtilities::ANNetwork& network, int games)
+	{
+		checkpointWrite(out, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+		checkpointWrite(out, CHECKPOINT_VERSION);
+		checkpointWrite(out, (uint32_t)sizeof(unsigned long int));
+		checkpointWrite(out, (int32_t)games);
+		writeSettings(out, network._settings);
+		checkpointWrite(out, (int32_t)replaySampling);
+		checkpointWrite(out, (int32_t)replayBatchesPerGame);
+
+		checkpointWrite(out, zobristPieceValues, BOARD_LENGTH * BOARD_LENGTH * 12);
+		checkpointWrite(out, zobristTurnValues, 2);
+		checkpointWrite(out, zobristKingMovedValues, 2);
+		checkpointWrite(out, zobristQRookMovedValues, 2);
+		checkpointWrite(out, zobristKRookMovedValues, 2);
+		checkpointWrite(out, zobristEnPassantValues, 9);
+
+		if (&network != trainedNetwork)
+		{
+			trainer.load(network);
+			trainedNetwork = &network;
+		}
+		trainer.save(out);
+		replayBuffer.save(out);
+	}
+
+	void BoardManager::saveCheckpoint(const AnnUtilities::ANNetwork& network, int games, std::string fileName)
+	{
+		std::vector<char> image;
+		AnnUtilities::SnapshotBuffer buffer(image);
+		std::ostream out(&buffer);
+		writeCheckpoint(out, network, games);
+		AnnUtilities::writeFileAtomically(fileName, image.data(), image.size(), syncPolicy);
+	}
+
+	// Serializes into a recycled buffer, the write happens on the snapshot thread
+	void BoardManager::snapshotCheckpoint(const AnnUtilities::ANNetwork& network, int games, std::string fileName)
+	{
+		std::vector<char> image = snapshotWriter.acquire();
+		{
+			AnnUtilities::SnapshotBuffer buffer(image);
+			std::ostream out(&buffer);
+			writeCheckpoint(out, network, games);
+		}
+		snapshotWriter.submit(fileName, std::move(image), nullptr);
+	}
+
+	// Replaces the network and the training state with the ones of the checkpoint and returns the number of games
+	// played before it was written
+	int BoardManager::loadCheckpoint(AnnUtilities::ANNetwork& network, std::string fileName)
+	{
+		std::ifstream file(fileName, std::ios_base::binary);
+		if (!file)
+		{
+			throw std::runtime_error("Cannot open checkpoint " + fileName);
+		}
+		char magic[sizeof(CHECKPOINT_MAGIC)];
+		checkpointRead(file, magic, sizeof(magic));
+		if (memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0)
+		{
+			throw std::runtime_error(fileName + ": not a checkpoint");
+		}
+		if (checkpointRead<uint32_t>(file) != CHECKPOINT_VERSION || checkpointRead<uint32_t>(file) != sizeof(unsigned long int))
+		{
+			throw std::runtime_error(fileName + ": checkpoint was written by an incompatible build");
+		}
+		int games = checkpointRead<int32_t>(file);
+		AnnUtilities::ANNSettings settings = readSettings(file);
+		replaySampling = (ReplaySampling)checkpointRead<int32_t>(file);
+		replayBatchesPerGame = checkpointRead<int32_t>(file);
+
+		checkpointRead(file, zobristPieceValues, BOARD_LENGTH * BOARD_LENGTH * 12);
+		checkpointRead(file, zobristTurnValues, 2);
+		checkpointRead(file, zobristKingMovedValues, 2);
+		checkpointRead(file, zobristQRookMovedValues, 2);
+		checkpointRead(file, zobristKRookMovedValues, 2);
+		checkpointRead(file, zobristEnPassantValues, 9);
+
+		trainer.restore(file, settings);
+		replayBuffer.restore(file);
+
+		network.Clean();
+		network._settings = settings;
+		network.Init();
+		trainer.store(network);
+		trainedNetwork = &network;
+		reset();
+		accumulator.invalidate();
+		return games;
+	}
+}
\ No newline at end of file
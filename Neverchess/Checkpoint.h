@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace BoardState
+{
+	static const char CHECKPOINT_MAGIC[8] = { 'N', 'C', 'C', 'K', 'P', 'T', 0, 0 };
+	static const uint32_t CHECKPOINT_VERSION = 1;
+
+	// A checkpoint is a raw binary image in the byte order and type sizes of the machine that wrote it. Everything a
+	// training run carries from one game to the next is in it, so a resumed run continues exactly where it stopped.
+	template <class T>
+	void checkpointWrite(std::ostream& out, const T* values, size_t count)
+	{
+		out.write((const char*)values, count * sizeof(T));
+	}
+
+	template <class T>
+	void checkpointWrite(std::ostream& out, const T& value)
+	{
+		checkpointWrite(out, &value, 1);
+	}
+
+	template <class T>
+	void checkpointRead(std::istream& in, T* values, size_t count)
+	{
+		in.read((char*)values, count * sizeof(T));
+		if (!in)
+		{
+			throw std::runtime_error("Checkpoint is truncated");
+		}
+	}
+
+	template <class T>
+	T checkpointRead(std::istream& in)
+	{
+		T value;
+		checkpointRead(in, &value, 1);
+		return value;
+	}
+
+	template <class T>
+	void checkpointWriteVector(std::ostream& out, const std::vector<T>& values)
+	{
+		checkpointWrite(out, (uint64_t)values.size());
+		checkpointWrite(out, values.data(), values.size());
+	}
+
+	template <class T>
+	void checkpointReadVector(std::istream& in, std::vector<T>& values)
+	{
+		values.resize((size_t)checkpointRead<uint64_t>(in));
+		checkpointRead(in, values.data(), values.size());
+	}
+
+	// Random engines are kept in their standard text form, which holds their whole state
+	template <class Engine>
+	void checkpointWriteEngine(std::ostream& out, const Engine& engine)
+	{
+		std::ostringstream text;
+		text << engine;
+		std::string state = text.str();
+		std::vector<char> bytes(state.begin(), state.end());
+		checkpointWriteVector(out, bytes);
+	}
+
+	template <class Engine>
+	void checkpointReadEngine(std::istream& in, Engine& engine)
+	{
+		std::vector<char> bytes;
+		checkpointReadVector(in, bytes);
+		std::istringstream text(std::string(bytes.begin(), bytes.end()));
+		text >> engine;
+		if (!text)
+		{
+			throw std::runtime_error("Checkpoint holds an invalid random engine state");
+		}
+	}
+}
\ No newline at end of file
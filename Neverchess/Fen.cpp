@@ -0,0 +1,309 @@
+#include "Fen.h"
+#include <sstream>
+#include <cctype>
+
+namespace BoardState
+{
+	static PieceCode fenPiece(char c)
+	{
+		switch (c)
+		{
+		case 'K': return PieceCode::W_KING;
+		case 'Q': return PieceCode::W_QUEEN;
+		case 'P': return PieceCode::W_PAWN;
+		case 'N': return PieceCode::W_KNIGHT;
+		case 'B': return PieceCode::W_BISHOP;
+		case 'R': return PieceCode::W_ROOK;
+		case 'k': return PieceCode::B_KING;
+		case 'q': return PieceCode::B_QUEEN;
+		case 'p': return PieceCode::B_PAWN;
+		case 'n': return PieceCode::B_KNIGHT;
+		case 'b': return PieceCode::B_BISHOP;
+		case 'r': return PieceCode::B_ROOK;
+		default: return PieceCode::EMPTY;
+		}
+	}
+
+	static char fenLetter(PieceCode piece)
+	{
+		switch (piece)
+		{
+		case PieceCode::W_KING: return 'K';
+		case PieceCode::W_QUEEN: return 'Q';
+		case PieceCode::W_PAWN: return 'P';
+		case PieceCode::W_KNIGHT: return 'N';
+		case PieceCode::W_BISHOP: return 'B';
+		case PieceCode::W_ROOK: return 'R';
+		case PieceCode::B_KING: return 'k';
+		case PieceCode::B_QUEEN: return 'q';
+		case PieceCode::B_PAWN: return 'p';
+		case PieceCode::B_KNIGHT: return 'n';
+		case PieceCode::B_BISHOP: return 'b';
+		case PieceCode::B_ROOK: return 'r';
+		default: return 0;
+		}
+	}
+
+	static bool black(PieceCode piece)
+	{
+		return ((int)piece >> (PIECE_CODE_LENGTH - 1)) != 0;
+	}
+
+	static PieceCode pieceAt(const PieceCode pieces[], int x, int y)
+	{
+		if (x < 0 || x >= BOARD_LENGTH || y < 0 || y >= BOARD_LENGTH)
+		{
+			return PieceCode::EMPTY;
+		}
+		return pieces[y * BOARD_LENGTH + x];
+	}
+
+	// Whether a piece of attacker's side attacks the square, the board does not have to be a legal position
+	static bool attacked(const PieceCode pieces[], bool attacker, int x, int y)
+	{
+		PieceCode pawn = attacker ? PieceCode::B_PAWN : PieceCode::W_PAWN;
+		int pawnRow = attacker ? y + 1 : y - 1;
+		if (pieceAt(pieces, x - 1, pawnRow) == pawn || pieceAt(pieces, x + 1, pawnRow) == pawn)
+		{
+			return true;
+		}
+		PieceCode knight = attacker ? PieceCode::B_KNIGHT : PieceCode::W_KNIGHT;
+		PieceCode king = attacker ? PieceCode::B_KING : PieceCode::W_KING;
+		const int jumps[8][2] = { { 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 }, { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 } };
+		const int steps[8][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }, { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+		for (int i = 0; i < 8; ++i)
+		{
+			if (pieceAt(pieces, x + jumps[i][0], y + jumps[i][1]) == knight || pieceAt(pieces, x + steps[i][0], y + steps[i][1]) == king)
+			{
+				return true;
+			}
+		}
+		// The first four steps are rook lines, the others bishop lines
+		PieceCode queen = attacker ? PieceCode::B_QUEEN : PieceCode::W_QUEEN;
+		for (int i = 0; i < 8; ++i)
+		{
+			PieceCode slider = i < 4 ? (attacker ? PieceCode::B_ROOK : PieceCode::W_ROOK) : (attacker ? PieceCode::B_BISHOP : PieceCode::W_BISHOP);
+			int tx = x + steps[i][0];
+			int ty = y + steps[i][1];
+			while (tx >= 0 && tx < BOARD_LENGTH && ty >= 0 && ty < BOARD_LENGTH && pieces[ty * BOARD_LENGTH + tx] == PieceCode::EMPTY)
+			{
+				tx += steps[i][0];
+				ty += steps[i][1];
+			}
+			PieceCode piece = pieceAt(pieces, tx, ty);
+			if (piece == slider || piece == queen)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool parseFen(const std::string& fen, BoardStateData& boardStateData)
+	{
+		std::istringstream fields(fen);
+		std::string placement;
+		std::string side;
+		std::string castling;
+		std::string enPassant;
+		if (!(fields >> placement >> side >> castling >> enPassant))
+		{
+			return false;
+		}
+		// The halfmove clock is optional, an EPD line has an operation in its place
+		int halfmoveClock = 0;
+		if (!(fields >> halfmoveClock) || halfmoveClock < 0)
+		{
+			halfmoveClock = 0;
+		}
+
+		BoardStateData parsed;
+		int kings[2] = { 0, 0 };
+		int kingSquares[2] = { 0, 0 };
+		int pieces[2] = { 0, 0 };
+		int x = 0;
+		int y = BOARD_LENGTH - 1;
+		for (char c : placement)
+		{
+			if (c == '/')
+			{
+				if (x != BOARD_LENGTH || y == 0)
+				{
+					return false;
+				}
+				x = 0;
+				--y;
+			}
+			else if (c >= '1' && c <= '8')
+			{
+				x += c - '0';
+				if (x > BOARD_LENGTH)
+				{
+					return false;
+				}
+			}
+			else
+			{
+				PieceCode piece = fenPiece(c);
+				if (piece == PieceCode::EMPTY || x >= BOARD_LENGTH)
+				{
+					return false;
+				}
+				// Pawns never stand on the first or last rank, the move generator would step off the board
+				if ((piece == PieceCode::W_PAWN || piece == PieceCode::B_PAWN) && (y == 0 || y == BOARD_LENGTH - 1))
+				{
+					return false;
+				}
+				if (piece == PieceCode::W_KING || piece == PieceCode::B_KING)
+				{
+					++kings[black(piece)];
+					kingSquares[black(piece)] = y * BOARD_LENGTH + x;
+				}
+				++pieces[black(piece)];
+				parsed._pieces[y * BOARD_LENGTH + x++] = piece;
+			}
+		}
+		// More than 16 pieces a side would not fit the ANN_MAX_ACTIVE_INPUTS the network inputs are sized for
+		if (x != BOARD_LENGTH || y != 0 || kings[0] != 1 || kings[1] != 1 || pieces[0] > 16 || pieces[1] > 16)
+		{
+			return false;
+		}
+
+		if (side != "w" && side != "b")
+		{
+			return false;
+		}
+		parsed._turn = side == "b";
+		// The side to move could capture the king
+		int waiting = kingSquares[!parsed._turn];
+		if (attacked(parsed._pieces, parsed._turn, waiting % BOARD_LENGTH, waiting / BOARD_LENGTH))
+		{
+			return false;
+		}
+
+		// A right only counts when king and rook are still on their squares, the move generator relies on it
+		bool rights[4] = { false, false, false, false };
+		if (castling != "-")
+		{
+			for (char c : castling)
+			{
+				size_t right = std::string("KQkq").find(c);
+				if (right == std::string::npos)
+				{
+					return false;
+				}
+				rights[right] = true;
+			}
+		}
+		for (int turn = 0; turn < 2; ++turn)
+		{
+			int row = turn * (BOARD_LENGTH - 1) * BOARD_LENGTH;
+			bool kingHome = parsed._pieces[row + 4] == (turn ? PieceCode::B_KING : PieceCode::W_KING);
+			PieceCode rook = turn ? PieceCode::B_ROOK : PieceCode::W_ROOK;
+			bool kRook = kingHome && rights[2 * turn] && parsed._pieces[row + 7] == rook;
+			bool qRook = kingHome && rights[2 * turn + 1] && parsed._pieces[row] == rook;
+			parsed._kingMoved[turn] = !kRook && !qRook;
+			parsed._kRookMoved[turn] = !kRook;
+			parsed._qRookMoved[turn] = !qRook;
+		}
+
+		if (enPassant != "-")
+		{
+			if (enPassant.size() != 2 || enPassant[0] < 'a' || enPassant[0] > 'h' || enPassant[1] != (parsed._turn ? '3' : '6'))
+			{
+				return false;
+			}
+			parsed._enPassant = enPassant[0] - 'a';
+		}
+
+		parsed._halfmoveClock = halfmoveClock;
+		boardStateData.copy(parsed);
+		return true;
+	}
+
+	std::string writeFen(const BoardStateData& boardStateData)
+	{
+		std::string fen;
+		for (int y = BOARD_LENGTH - 1; y >= 0; --y)
+		{
+			int empty = 0;
+			for (int x = 0; x < BOARD_LENGTH; ++x)
+			{
+				char letter = fenLetter(boardStateData._pieces[y * BOARD_LENGTH + x]);
+				if (letter == 0)
+				{
+					++empty;
+					continue;
+				}
+				if (empty > 0)
+				{
+					fen += (char)('0' + empty);
+					empty = 0;
+				}
+				fen += letter;
+			}
+			if (empty > 0)
+			{
+				fen += (char)('0' + empty);
+			}
+			if (y > 0)
+			{
+				fen += '/';
+			}
+		}
+		fen += boardStateData._turn ? " b " : " w ";
+
+		std::string castling;
+		for (int turn = 0; turn < 2; ++turn)
+		{
+			int row = turn * (BOARD_LENGTH - 1) * BOARD_LENGTH;
+			PieceCode rook = turn ? PieceCode::B_ROOK : PieceCode::W_ROOK;
+			bool kingHome = !boardStateData._kingMoved[turn] && boardStateData._pieces[row + 4] == (turn ? PieceCode::B_KING : PieceCode::W_KING);
+			if (kingHome && !boardStateData._kRookMoved[turn] && boardStateData._pieces[row + 7] == rook)
+			{
+				castling += turn ? 'k' : 'K';
+			}
+			if (kingHome && !boardStateData._qRookMoved[turn] && boardStateData._pieces[row] == rook)
+			{
+				castling += turn ? 'q' : 'Q';
+			}
+		}
+		fen += castling.empty() ? "-" : castling;
+
+		if (boardStateData._enPassant >= 0)
+		{
+			fen += ' ';
+			fen += (char)('a' + boardStateData._enPassant);
+			fen += boardStateData._turn ? '3' : '6';
+		}
+		else
+		{
+			fen += " -";
+		}
+		return fen + " " + std::to_string(boardStateData._halfmoveClock) + " 1";
+	}
+
+	std::string writeMove(const MoveData& move, bool turn)
+	{
+		if (move.shortCastle || move.longCastle)
+		{
+			std::string rank(1, turn ? '8' : '1');
+			return "e" + rank + (move.shortCastle ? "g" : "c") + rank;
+		}
+		if (move.xStart < 0)
+		{
+			// No move, e.g. from a position without legal moves
+			return "0000";
+		}
+		std::string text;
+		text += (char)('a' + move.xStart);
+		text += (char)('1' + move.yStart);
+		text += (char)('a' + move.xEnd);
+		text += (char)('1' + move.yEnd);
+		if (move.upgrade != PieceCode::EMPTY)
+		{
+			text += (char)tolower(fenLetter(move.upgrade));
+		}
+		return text;
+	}
+}
\ No newline at end of file
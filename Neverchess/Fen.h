@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include "BoardState.h"
+
+namespace BoardState
+{
+	// Reads a position in Forsyth-Edwards Notation. The move counters are optional and the fullmove number is ignored,
+	// so the first four fields of an EPD line are enough. Returns false and leaves boardStateData alone when the text
+	// is not a position the engine can search: not one king a side, more than 16 pieces a side, a pawn on the first or
+	// last rank or the side not to move in check.
+	bool parseFen								(const std::string& fen, BoardStateData& boardStateData);
+	// The fullmove number is not kept on the board and is written as 1
+	std::string writeFen						(const BoardStateData& boardStateData);
+	// A move in long algebraic notation as UCI writes it, e.g. e2e4, e1g1 or e7e8q. turn is the side that plays it.
+	std::string writeMove						(const MoveData& move, bool turn);
+}
\ No newline at end of file
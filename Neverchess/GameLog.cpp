@@ -0,0 +1,307 @@
+#include "GameLog.h"
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace BoardState
+{
+	static_assert(sizeof(GameRecordHeader) % 4 == 0, "game records have to keep their moves aligned");
+
+	static uint32_t packSquare(int x, int y)
+	{
+		return x < 0 || y < 0 ? GAME_LOG_NO_SQUARE : y * BOARD_LENGTH + x;
+	}
+
+	static void unpackSquare(uint32_t square, int& x, int& y)
+	{
+		x = square == GAME_LOG_NO_SQUARE ? -1 : (int)square % BOARD_LENGTH;
+		y = square == GAME_LOG_NO_SQUARE ? -1 : (int)square / BOARD_LENGTH;
+	}
+
+	uint32_t packMove(const MoveData& move)
+	{
+		return packSquare(move.xStart, move.yStart)
+			| packSquare(move.xEnd, move.yEnd) << 7
+			| (uint32_t)packPiece(move.upgrade) << 14
+			| (uint32_t)move.shortCastle << 18
+			| (uint32_t)move.longCastle << 19
+			| (uint32_t)move.doublePawnMove << 20
+			| (uint32_t)move.enPassant << 21;
+	}
+
+	MoveData unpackMove(uint32_t packed)
+	{
+		MoveData move;
+		unpackSquare(packed & 127, move.xStart, move.yStart);
+		unpackSquare((packed >> 7) & 127, move.xEnd, move.yEnd);
+		move.upgrade = unpackPiece((packed >> 14) & 15);
+		move.shortCastle = (packed >> 18) & 1;
+		move.longCastle = (packed >> 19) & 1;
+		move.doublePawnMove = (packed >> 20) & 1;
+		move.enPassant = (packed >> 21) & 1;
+		return move;
+	}
+
+	size_t gameRecordBytes(uint32_t moveCount)
+	{
+		return sizeof(GameRecordHeader) + (size_t)moveCount * (sizeof(uint32_t) + sizeof(float));
+	}
+
+	GameLogWriter::~GameLogWriter()
+	{
+		close();
+	}
+
+	// Appends to an existing log or starts a new one
+	void GameLogWriter::open(const std::string& logFile)
+	{
+		close();
+		fileName = logFile;
+		GameLogHeader header;
+		{
+			std::ifstream existing(logFile, std::ios_base::binary | std::ios_base::ate);
+			logBytes = existing ? (uint64_t)existing.tellg() : 0;
+			if (logBytes > 0)
+			{
+				existing.seekg(0);
+				existing.read((char*)&header, sizeof(header));
+				if (!existing || memcmp(header.magic, GAME_LOG_MAGIC, sizeof(GAME_LOG_MAGIC)) != 0
+					|| header.version != GAME_LOG_VERSION || header.recordHeaderBytes != sizeof(GameRecordHeader))
+				{
+					throw std::runtime_error(logFile + ": not a game log of this version");
+				}
+			}
+		}
+		log.open(logFile, std::ios_base::binary | std::ios_base::app);
+		// An index without its log belongs to a log that is gone
+		index.open(logFile + ".idx", std::ios_base::binary | (logBytes == 0 ? std::ios_base::trunc : std::ios_base::app));
+		if (!log || !index)
+		{
+			throw std::runtime_error(logFile + ": could not open game log");
+		}
+		if (logBytes == 0)
+		{
+			memcpy(header.magic, GAME_LOG_MAGIC, sizeof(GAME_LOG_MAGIC));
+			header.version = GAME_LOG_VERSION;
+			header.recordHeaderBytes = sizeof(GameRecordHeader);
+			log.write((const char*)&header, sizeof(header));
+			logBytes = sizeof(header);
+		}
+		buffer.reserve(GAME_LOG_BUFFER);
+	}
+
+	// Appends after the first keepGames games of the log. Games written after them, and a record a crash cut short,
+	// are dropped, so a run resumed from a checkpoint logs the games it replays only once.
+	void GameLogWriter::open(const std::string& logFile, int keepGames)
+	{
+		close();
+		if (std::ifstream(logFile, std::ios_base::binary).peek() != std::ifstream::traits_type::eof())
+		{
+			std::vector<uint64_t> kept;
+			uint64_t bytes;
+			{
+				GameLogReader reader;
+				reader.open(logFile);
+				int games = std::min(std::max(keepGames, 0), reader.games());
+				for (int g = 0; g < games; ++g)
+				{
+					kept.push_back(reader.offset(g));
+				}
+				bytes = games == 0 ? sizeof(GameLogHeader) : kept.back() + gameRecordBytes(reader.header(games - 1).moveCount);
+			}
+#ifdef _WIN32
+			HANDLE file = CreateFileA(logFile.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			LARGE_INTEGER size;
+			size.QuadPart = (LONGLONG)bytes;
+			bool cut = file != INVALID_HANDLE_VALUE && SetFilePointerEx(file, size, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+			if (file != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(file);
+			}
+#else
+			bool cut = ::truncate(logFile.c_str(), (off_t)bytes) == 0;
+#endif
+			std::ofstream index(logFile + ".idx", std::ios_base::binary | std::ios_base::trunc);
+			index.write((const char*)kept.data(), kept.size() * sizeof(uint64_t));
+			if (!cut || !index)
+			{
+				throw std::runtime_error(logFile + ": could not drop the games after game " + std::to_string(keepGames));
+			}
+		}
+		open(logFile);
+	}
+
+	void GameLogWriter::write(const PlayedGame& game)
+	{
+		GameRecordHeader header;
+		memset(&header, 0, sizeof(header));
+		header.moveCount = (uint32_t)game.moves.size();
+		header.result = (uint8_t)(game.whiteWin ? GameResult::WHITE_WIN : game.blackWin ? GameResult::BLACK_WIN : GameResult::DRAW);
+		header.ending = (uint8_t)game.ending;
+		packPosition(game.start, header.start);
+
+		offsets.push_back(logBytes + buffer.size());
+		size_t at = buffer.size();
+		buffer.resize(at + gameRecordBytes(header.moveCount));
+		memcpy(&buffer[at], &header, sizeof(header));
+		uint32_t* packed = (uint32_t*)&buffer[at + sizeof(header)];
+		for (uint32_t i = 0; i < header.moveCount; ++i)
+		{
+			packed[i] = packMove(game.moves[i]);
+		}
+		float* values = (float*)(packed + header.moveCount);
+		for (uint32_t i = 0; i < header.moveCount; ++i)
+		{
+			values[i] = i < game.values.size() ? game.values[i] : 0.0f;
+		}
+		if (buffer.size() >= GAME_LOG_BUFFER)
+		{
+			flush();
+		}
+	}
+
+	void GameLogWriter::flush()
+	{
+		if (!log.is_open() || buffer.empty())
+		{
+			return;
+		}
+		log.write(buffer.data(), buffer.size());
+		log.flush();
+		index.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+		index.flush();
+		if (!log || !index)
+		{
+			throw std::runtime_error(fileName + ": could not write game log");
+		}
+		logBytes += buffer.size();
+		buffer.clear();
+		offsets.clear();
+	}
+
+	void GameLogWriter::close()
+	{
+		flush();
+		log.close();
+		index.close();
+	}
+
+	GameLogReader::~GameLogReader()
+	{
+		close();
+	}
+
+	void GameLogReader::close()
+	{
+		if (mapping != nullptr)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(mapping);
+#else
+			munmap(mapping, bytes);
+#endif
+		}
+		mapping = nullptr;
+		data = nullptr;
+		bytes = 0;
+		offsets.clear();
+	}
+
+	bool GameLogReader::recordFits(uint64_t offset) const
+	{
+		if (offset < sizeof(GameLogHeader) || offset % 4 != 0 || offset + sizeof(GameRecordHeader) > bytes)
+		{
+			return false;
+		}
+		const GameRecordHeader& h = *(const GameRecordHeader*)(data + offset);
+		return offset + gameRecordBytes(h.moveCount) <= bytes;
+	}
+
+	void GameLogReader::open(const std::string& logFile)
+	{
+		close();
+#ifdef _WIN32
+		HANDLE file = CreateFileA(logFile.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error(logFile + ": could not open game log");
+		}
+		LARGE_INTEGER size;
+		GetFileSizeEx(file, &size);
+		bytes = (size_t)size.QuadPart;
+		HANDLE view = bytes > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+		mapping = view != nullptr ? MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (view != nullptr)
+		{
+			CloseHandle(view);
+		}
+		CloseHandle(file);
+#else
+		int file = ::open(logFile.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			throw std::runtime_error(logFile + ": could not open game log");
+		}
+		struct stat info;
+		fstat(file, &info);
+		bytes = (size_t)info.st_size;
+		void* p = bytes > 0 ? mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+		::close(file);
+		mapping = p != MAP_FAILED ? p : nullptr;
+		if (mapping != nullptr)
+		{
+			madvise(mapping, bytes, MADV_SEQUENTIAL);
+		}
+#endif
+		data = (const char*)mapping;
+		const GameLogHeader* logHeader = (const GameLogHeader*)data;
+		if (data == nullptr || bytes < sizeof(GameLogHeader) || memcmp(logHeader->magic, GAME_LOG_MAGIC, sizeof(GAME_LOG_MAGIC)) != 0
+			|| logHeader->version != GAME_LOG_VERSION || logHeader->recordHeaderBytes != sizeof(GameRecordHeader))
+		{
+			close();
+			throw std::runtime_error(logFile + ": not a game log of this version");
+		}
+
+		std::ifstream index(logFile + ".idx", std::ios_base::binary);
+		uint64_t offset;
+		while (index.read((char*)&offset, sizeof(offset)) && recordFits(offset) && (offsets.empty() || offset > offsets.back()))
+		{
+			offsets.push_back(offset);
+		}
+		uint64_t next = offsets.empty() ? sizeof(GameLogHeader) : offsets.back() + gameRecordBytes(header(games() - 1).moveCount);
+		while (recordFits(next))
+		{
+			offsets.push_back(next);
+			next += gameRecordBytes(header(games() - 1).moveCount);
+		}
+	}
+
+	// Copies a game out of the log
+	PlayedGame GameLogReader::game(int game) const
+	{
+		const GameRecordHeader& h = header(game);
+		PlayedGame played;
+		played.index = game;
+		unpackPosition(h.start, played.start);
+		played.whiteWin = h.result == (uint8_t)GameResult::WHITE_WIN;
+		played.blackWin = h.result == (uint8_t)GameResult::BLACK_WIN;
+		played.ending = (GameEnd)h.ending;
+		const uint32_t* packed = moves(game);
+		played.moves.resize(h.moveCount);
+		played.values.assign(values(game), values(game) + h.moveCount);
+		for (uint32_t i = 0; i < h.moveCount; ++i)
+		{
+			played.moves[i] = unpackMove(packed[i]);
+		}
+		return played;
+	}
+}
\ No newline at end of file
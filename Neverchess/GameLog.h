@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "BoardState.h"
+#include "ReplayBuffer.h"
+
+namespace BoardState
+{
+	static const char GAME_LOG_MAGIC[8] = { 'N', 'C', 'G', 'A', 'M', 'E', 'S', 0 };
+	static const uint32_t GAME_LOG_VERSION = 1;
+	// Bytes the writer collects before it appends them to the file
+	static const size_t GAME_LOG_BUFFER = 1 << 20;
+	// Square index used for the unset coordinates of castling moves
+	static const int GAME_LOG_NO_SQUARE = 64;
+
+	struct GameLogHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t recordHeaderBytes;
+	};
+
+	// Every game is this header followed by moveCount packed moves and moveCount search values, so the moves and
+	// values of a mapped log are read in place. The header is a multiple of 4 bytes to keep both arrays aligned.
+	struct GameRecordHeader
+	{
+		uint32_t moveCount;
+		uint8_t result;
+		uint8_t ending;
+		uint8_t reserved[2];
+		PackedPosition start;
+		uint8_t padding[2];
+	};
+
+	// Start and end square as 7 bit indices, the promotion piece as a 4 bit code and the four move flags
+	uint32_t packMove							(const MoveData& move);
+	MoveData unpackMove							(uint32_t packed);
+	size_t gameRecordBytes						(uint32_t moveCount);
+
+	// Appends games to a log file and their offsets to fileName + ".idx". Games are collected in memory and written
+	// when GAME_LOG_BUFFER is full and on flush, the log before the index, so the index never points past the log.
+	class GameLogWriter
+	{
+	private:
+		std::string fileName;
+		std::ofstream log;
+		std::ofstream index;
+		std::vector<char> buffer;
+		std::vector<uint64_t> offsets;
+		uint64_t logBytes = 0;
+
+	public:
+		GameLogWriter							() = default;
+		GameLogWriter							(const GameLogWriter&) = delete;
+		GameLogWriter& operator=				(const GameLogWriter&) = delete;
+		~GameLogWriter							();
+
+		void open								(const std::string& logFile);
+		void open								(const std::string& logFile, int keepGames);
+		void write								(const PlayedGame& game);
+		void flush								();
+		void close								();
+		bool isOpen								() const { return log.is_open(); }
+	};
+
+	// Maps a log read-only. Offsets come from the index, games written after the last indexed one are found by
+	// walking the records, and a record cut short by a crash ends the log.
+	class GameLogReader
+	{
+	private:
+		const char* data = nullptr;
+		size_t bytes = 0;
+		void* mapping = nullptr;
+		std::vector<uint64_t> offsets;
+
+		bool recordFits							(uint64_t offset) const;
+
+	public:
+		GameLogReader							() = default;
+		GameLogReader							(const GameLogReader&) = delete;
+		GameLogReader& operator=				(const GameLogReader&) = delete;
+		~GameLogReader							();
+
+		void open								(const std::string& logFile);
+		void close								();
+		int games								() const { return (int)offsets.size(); }
+		uint64_t offset							(int game) const { return offsets[game]; }
+		const GameRecordHeader& header			(int game) const { return *(const GameRecordHeader*)(data + offsets[game]); }
+		const uint32_t* moves					(int game) const { return (const uint32_t*)(data + offsets[game] + sizeof(GameRecordHeader)); }
+		const float* values						(int game) const { return (const float*)(moves(game) + header(game).moveCount); }
+		PlayedGame game							(int game) const;
+
+		// Calls f(position, value, game, ply) for the position after every move of every game, value is the search
+		// value of the move that led to it
+		template <class F>
+		void forEachPosition(F f) const
+		{
+			BoardStateData boardStateData;
+			for (int g = 0; g < games(); ++g)
+			{
+				const GameRecordHeader& h = header(g);
+				const uint32_t* packed = moves(g);
+				const float* searchValues = values(g);
+				unpackPosition(h.start, boardStateData);
+				for (uint32_t ply = 0; ply < h.moveCount; ++ply)
+				{
+					applyMove(boardStateData, unpackMove(packed[ply]));
+					f((const BoardStateData&)boardStateData, searchValues[ply], g, (int)ply);
+				}
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "InferenceNetwork.h"
+#include "Kernels.h"
+#include <algorithm>
+
+namespace AnnUtilities
+{
+	InferenceNetwork::InferenceNetwork(const ANNetwork& network, bool hugePages)
+	{
+		arena.allocate(network._settings, ArenaContents::PARAMETERS, 0, hugePages);
+		arena.load(network);
+	}
+
+	InferenceNetwork::InferenceNetwork(const std::string& modelFile)
+	{
+		arena.mapModel(modelFile);
+	}
+
+	// Sizes a scratch for this network, only reallocates when the layout differs from the last one
+	void InferenceNetwork::prepare(InferenceScratch& scratch) const
+	{
+		scratch.offsets.resize(layerCount());
+		size_t offset = 0;
+		for (int i = 0; i < layerCount(); ++i)
+		{
+			scratch.offsets[i] = offset;
+			offset += layer(i).paddedRows;
+		}
+		scratch.outputs.resize(offset);
+	}
+
+	// Activates the first hidden layer pre-activations and runs the remaining layers. Returns the network output.
+	float InferenceNetwork::forward(const float* preactivations, InferenceScratch& scratch) const
+	{
+		const KernelTable& k = kernels();
+		float* outputs = &scratch.outputs[0];
+		std::copy(preactivations, preactivations + hiddenSize(), outputs);
+		k.activate(layer(0).actfunc, outputs, hiddenSize());
+		for (int i = 1; i < layerCount(); ++i)
+		{
+			const ArenaLayer& l = layer(i);
+			float* input = &scratch.outputs[scratch.offsets[i - 1]];
+			float* output = &scratch.outputs[scratch.offsets[i]];
+			k.gemv(at(l.weights), input, at(l.biases), output, l.paddedRows, l.paddedCols);
+			k.activate(l.actfunc, output, l.paddedRows);
+		}
+		return scratch.outputs[scratch.offsets.back()];
+	}
+
+	// forward for batch samples at once, preactivations holds hiddenSize() values per sample. Every layer is one gemm
+	// over the batch, so its weights are read once for all samples instead of once per sample.
+	void InferenceNetwork::forwardBatch(const float* preactivations, int batch, InferenceScratch& scratch, float* results) const
+	{
+		const KernelTable& k = kernels();
+		size_t widest = 0;
+		for (int i = 0; i < layerCount(); ++i)
+		{
+			widest = std::max(widest, (size_t)layer(i).paddedRows);
+		}
+		scratch.batchOutputs[0].resize(widest * batch);
+		scratch.batchOutputs[1].resize(widest * batch);
+		float* input = &scratch.batchOutputs[0][0];
+		float* output = &scratch.batchOutputs[1][0];
+		std::copy(preactivations, preactivations + (size_t)hiddenSize() * batch, input);
+		k.activate(layer(0).actfunc, input, hiddenSize() * batch);
+		for (int i = 1; i < layerCount(); ++i)
+		{
+			const ArenaLayer& l = layer(i);
+			k.gemm(at(l.weights), input, at(l.biases), output, l.paddedRows, l.paddedCols, batch);
+			k.activate(l.actfunc, output, l.paddedRows * batch);
+			std::swap(input, output);
+		}
+		for (int b = 0; b < batch; ++b)
+		{
+			results[b] = input[b * layer(layerCount() - 1).paddedRows];
+		}
+	}
+}
\ No newline at end of file
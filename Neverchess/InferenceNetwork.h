@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <ANNetwork.h>
+#include "NetworkArena.h"
+
+namespace AnnUtilities
+{
+	// Activations of every layer for one evaluation at a time, and of the layers of a batch in two alternating
+	// blocks. Each thread keeps its own.
+	struct InferenceScratch
+	{
+		std::vector<float> outputs;
+		std::vector<size_t> offsets;
+		std::vector<float> batchOutputs[2];
+	};
+
+	// Read-only copy of the weights and biases of a trained network. It has no error, gradient or momentum buffers and
+	// is never written after construction, so any number of threads can evaluate it at once with their own scratch.
+	// Built from a model file it evaluates straight from the mapped file.
+	class InferenceNetwork
+	{
+	private:
+		NetworkArena arena;
+
+	public:
+		InferenceNetwork						(const ANNetwork& network, bool hugePages);
+		explicit InferenceNetwork				(const std::string& modelFile);
+		InferenceNetwork						(const InferenceNetwork&) = delete;
+		InferenceNetwork& operator=				(const InferenceNetwork&) = delete;
+
+		const ArenaLayer& layer					(int i) const { return arena.layer(i); }
+		int layerCount							() const { return arena.layerCount(); }
+		int inputSize							() const { return arena.inputSize(); }
+		// Padded size of the first hidden layer, the length of a column and of the first layer pre-activations
+		int hiddenSize							() const { return arena.layer(0).paddedRows; }
+		const float* column						(int input) const { return arena.at(arena.layer(0).weights) + input * hiddenSize(); }
+		const float* firstBiases				() const { return arena.at(arena.layer(0).biases); }
+		const float* at							(size_t offset) const { return arena.at(offset); }
+		size_t bytes							() const { return arena.bytes(); }
+
+		void prepare							(InferenceScratch& scratch) const;
+		float forward							(const float* preactivations, InferenceScratch& scratch) const;
+		void forwardBatch						(const float* preactivations, int batch, InferenceScratch& scratch, float* results) const;
+	};
+}
\ No newline at end of file
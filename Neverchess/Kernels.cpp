@@ -0,0 +1,363 @@
+#include "Kernels.h"
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace AnnUtilities
+{
+	static void scalarGemv(const float* weights, const float* input, const float* biases, float* output, int rows, int cols)
+	{
+		for (int r = 0; r < rows; ++r)
+		{
+			float sum = 0.0f;
+			for (int c = 0; c < cols; ++c)
+			{
+				sum += weights[r * cols + c] * input[c];
+			}
+			output[r] = biases != nullptr ? sum + biases[r] : sum;
+		}
+	}
+
+	static void scalarGemvTransposed(const float* weights, const float* input, float* output, int rows, int cols)
+	{
+		for (int c = 0; c < cols; ++c)
+		{
+			output[c] = 0.0f;
+		}
+		for (int r = 0; r < rows; ++r)
+		{
+			for (int c = 0; c < cols; ++c)
+			{
+				output[c] += weights[r * cols + c] * input[r];
+			}
+		}
+	}
+
+	static void scalarGemm(const float* weights, const float* inputs, const float* biases, float* outputs, int rows, int cols, int batch)
+	{
+		for (int b = 0; b < batch; ++b)
+		{
+			scalarGemv(weights, inputs + b * cols, biases, outputs + b * rows, rows, cols);
+		}
+	}
+
+	static void scalarGemmTransposed(const float* weights, const float* inputs, float* outputs, int rows, int cols, int batch)
+	{
+		for (int b = 0; b < batch; ++b)
+		{
+			scalarGemvTransposed(weights, inputs + b * rows, outputs + b * cols, rows, cols);
+		}
+	}
+
+	static void scalarOuterAccumulate(float* gradients, const float* deltas, const float* inputs, int rows, int cols, int batch)
+	{
+		for (int b = 0; b < batch; ++b)
+		{
+			for (int r = 0; r < rows; ++r)
+			{
+				for (int c = 0; c < cols; ++c)
+				{
+					gradients[r * cols + c] += deltas[b * rows + r] * inputs[b * cols + c];
+				}
+			}
+		}
+	}
+
+	static void scalarAxpy(float* y, const float* x, float scale, int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			y[i] += scale * x[i];
+		}
+	}
+
+	static void scalarActivate(ACTFUNC actfunc, float* values, int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			switch (actfunc)
+			{
+			case ACTFUNC::SIGMOID:
+				values[i] = sigmoid(values[i]);
+				break;
+			case ACTFUNC::RELU:
+				values[i] = relu(values[i]);
+				break;
+			case ACTFUNC::LEAKY_RELU:
+				values[i] = leakyRelu(values[i]);
+				break;
+			case ACTFUNC::TANH:
+				values[i] = hypTanh(values[i]);
+				break;
+			}
+		}
+	}
+
+	static void scalarDerivative(ACTFUNC actfunc, const float* outputs, float* error, int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			float y = outputs[i];
+			switch (actfunc)
+			{
+			case ACTFUNC::SIGMOID:
+				error[i] *= y * (1.0f - y);
+				break;
+			case ACTFUNC::RELU:
+				error[i] *= y > 0.0f ? 1.0f : 0.0f;
+				break;
+			case ACTFUNC::LEAKY_RELU:
+				error[i] *= y > 0.0f ? 1.0f : 0.01f;
+				break;
+			case ACTFUNC::TANH:
+				error[i] *= 1.0f - y * y;
+				break;
+			}
+		}
+	}
+
+	static void scalarGemvInt8(const signed char* weights, const signed char* input, int* output, int rows, int cols)
+	{
+		for (int r = 0; r < rows; ++r)
+		{
+			int sum = 0;
+			for (int c = 0; c < cols; ++c)
+			{
+				sum += weights[r * cols + c] * input[c];
+			}
+			output[r] = sum;
+		}
+	}
+
+	static void scalarAddInt16(int* values, const short* column, int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			values[i] += column[i];
+		}
+	}
+
+	static const KernelTable scalarTable = {
+		SimdLevel::SCALAR,
+		&scalarGemv,
+		&scalarGemvTransposed,
+		&scalarGemm,
+		&scalarGemmTransposed,
+		&scalarOuterAccumulate,
+		&scalarAxpy,
+		&scalarActivate,
+		&scalarDerivative,
+		&scalarGemvInt8,
+		&scalarAddInt16
+	};
+
+	const KernelTable* kernelTable(SimdLevel level)
+	{
+		switch (level)
+		{
+		case SimdLevel::SCALAR:
+			return &scalarTable;
+		case SimdLevel::SSE42:
+			return sse42Kernels();
+		case SimdLevel::AVX2:
+			return avx2Kernels();
+		case SimdLevel::AVX512:
+			return avx512Kernels();
+		}
+		return nullptr;
+	}
+
+	bool cpuSupports(SimdLevel level)
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse42 = (info[2] & (1 << 20)) != 0;
+		bool fma = (info[2] & (1 << 12)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		bool avx2 = false;
+		bool avx512 = false;
+		if (maxLeaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+			avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 && (xcr0 & 0xe6) == 0xe6;
+		}
+		switch (level)
+		{
+		case SimdLevel::SCALAR:
+			return true;
+		case SimdLevel::SSE42:
+			return sse42;
+		case SimdLevel::AVX2:
+			return avx2 && fma;
+		case SimdLevel::AVX512:
+			return avx512;
+		}
+		return false;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_cpu_init();
+		switch (level)
+		{
+		case SimdLevel::SCALAR:
+			return true;
+		case SimdLevel::SSE42:
+			return __builtin_cpu_supports("sse4.2");
+		case SimdLevel::AVX2:
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		case SimdLevel::AVX512:
+			return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+		}
+		return false;
+#else
+		return level == SimdLevel::SCALAR;
+#endif
+	}
+
+	const char* simdLevelName(SimdLevel level)
+	{
+		switch (level)
+		{
+		case SimdLevel::SCALAR:
+			return "scalar";
+		case SimdLevel::SSE42:
+			return "SSE4.2";
+		case SimdLevel::AVX2:
+			return "AVX2";
+		case SimdLevel::AVX512:
+			return "AVX-512";
+		}
+		return "unknown";
+	}
+
+	static float relativeDifference(const std::vector<float>& a, const std::vector<float>& b)
+	{
+		float worst = 0.0f;
+		for (unsigned int i = 0; i < a.size(); ++i)
+		{
+			worst = std::max(worst, fabsf(a[i] - b[i]) / std::max(1.0f, fabsf(a[i])));
+		}
+		return worst;
+	}
+
+	// Sizes are chosen so that every kernel also runs its partial register and partial tile paths
+	float compareKernels(const KernelTable& reference, const KernelTable& candidate)
+	{
+		const int rows = 37;
+		const int cols = 61;
+		const int batch = 5;
+		unsigned int seed = 12345;
+		auto random = [&seed]()
+		{
+			seed = seed * 1664525u + 1013904223u;
+			return (float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+		};
+		std::vector<float> weights(rows * cols);
+		std::vector<float> biases(rows);
+		std::vector<float> inputs(batch * cols);
+		std::vector<float> deltas(batch * rows);
+		for (float& v : weights) v = random();
+		for (float& v : biases) v = random();
+		for (float& v : inputs) v = random();
+		for (float& v : deltas) v = random();
+
+		float worst = 0.0f;
+		std::vector<float> a(batch * rows);
+		std::vector<float> b(batch * rows);
+		reference.gemv(&weights[0], &inputs[0], &biases[0], &a[0], rows, cols);
+		candidate.gemv(&weights[0], &inputs[0], &biases[0], &b[0], rows, cols);
+		worst = std::max(worst, relativeDifference(a, b));
+		reference.gemm(&weights[0], &inputs[0], &biases[0], &a[0], rows, cols, batch);
+		candidate.gemm(&weights[0], &inputs[0], &biases[0], &b[0], rows, cols, batch);
+		worst = std::max(worst, relativeDifference(a, b));
+
+		a.assign(batch * cols, 0.0f);
+		b.assign(batch * cols, 0.0f);
+		reference.gemvTransposed(&weights[0], &deltas[0], &a[0], rows, cols);
+		candidate.gemvTransposed(&weights[0], &deltas[0], &b[0], rows, cols);
+		worst = std::max(worst, relativeDifference(a, b));
+		reference.gemmTransposed(&weights[0], &deltas[0], &a[0], rows, cols, batch);
+		candidate.gemmTransposed(&weights[0], &deltas[0], &b[0], rows, cols, batch);
+		worst = std::max(worst, relativeDifference(a, b));
+
+		a = weights;
+		b = weights;
+		reference.outerAccumulate(&a[0], &deltas[0], &inputs[0], rows, cols, batch);
+		candidate.outerAccumulate(&b[0], &deltas[0], &inputs[0], rows, cols, batch);
+		worst = std::max(worst, relativeDifference(a, b));
+		reference.axpy(&a[0], &weights[0], 0.37f, rows * cols);
+		candidate.axpy(&b[0], &weights[0], 0.37f, rows * cols);
+		worst = std::max(worst, relativeDifference(a, b));
+
+		const ACTFUNC actfuncs[] = { ACTFUNC::SIGMOID, ACTFUNC::RELU, ACTFUNC::LEAKY_RELU, ACTFUNC::TANH };
+		for (ACTFUNC actfunc : actfuncs)
+		{
+			a.resize(cols);
+			for (int i = 0; i < cols; ++i)
+			{
+				a[i] = inputs[i] * 12.0f;
+			}
+			b = a;
+			reference.activate(actfunc, &a[0], cols);
+			candidate.activate(actfunc, &b[0], cols);
+			worst = std::max(worst, relativeDifference(a, b));
+
+			std::vector<float> outputs = a;
+			a.assign(deltas.begin(), deltas.begin() + cols);
+			b = a;
+			reference.derivative(actfunc, &outputs[0], &a[0], cols);
+			candidate.derivative(actfunc, &outputs[0], &b[0], cols);
+			worst = std::max(worst, relativeDifference(a, b));
+		}
+
+		// Integer kernels have to match exactly
+		const int padded = QUANT_PADDING;
+		std::vector<signed char> quantWeights(padded * padded);
+		std::vector<signed char> quantInput(padded);
+		std::vector<short> column(padded);
+		for (signed char& v : quantWeights) v = (signed char)(random() * 127.0f);
+		for (signed char& v : quantInput) v = (signed char)(random() * 127.0f);
+		for (short& v : column) v = (short)(random() * 32767.0f);
+		std::vector<int> intA(padded, 7);
+		std::vector<int> intB(padded, 7);
+		reference.addInt16(&intA[0], &column[0], padded);
+		candidate.addInt16(&intB[0], &column[0], padded);
+		if (intA != intB)
+		{
+			return 1.0f;
+		}
+		reference.gemvInt8(&quantWeights[0], &quantInput[0], &intA[0], padded, padded);
+		candidate.gemvInt8(&quantWeights[0], &quantInput[0], &intB[0], padded, padded);
+		if (intA != intB)
+		{
+			return 1.0f;
+		}
+		return worst;
+	}
+
+	static const KernelTable& selectKernels()
+	{
+		const SimdLevel levels[] = { SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE42 };
+		for (SimdLevel level : levels)
+		{
+			const KernelTable* table = kernelTable(level);
+			if (table != nullptr && cpuSupports(level) && compareKernels(scalarTable, *table) <= KERNEL_TOLERANCE)
+			{
+				return *table;
+			}
+		}
+		return scalarTable;
+	}
+
+	const KernelTable& kernels()
+	{
+		static const KernelTable& table = selectKernels();
+		return table;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+#include <Functions.h>
+
+namespace AnnUtilities
+{
+	enum class SimdLevel
+	{
+		SCALAR,
+		SSE42,
+		AVX2,
+		AVX512
+	};
+
+	// Row and column counts of the integer kernels have to be multiples of this
+	static const int QUANT_PADDING = 64;
+
+	// Largest relative difference a vectorized kernel may have against the scalar kernels before dispatch rejects it
+	static const float KERNEL_TOLERANCE = 1e-4f;
+
+	// Dense kernels for the row-major weight matrices of a layer: rows is the layer size and cols the size of the
+	// previous layer, so weights[r * cols + c] connects input c to node r. Batched kernels take one sample per row.
+	// Derivatives are computed from the activated outputs, which is all a layer keeps.
+	struct KernelTable
+	{
+		SimdLevel level;
+		// output[r] = weights[r] . input + biases[r], biases may be null
+		void (*gemv)(const float* weights, const float* input, const float* biases, float* output, int rows, int cols);
+		// output[c] = sum over r of weights[r * cols + c] * input[r]
+		void (*gemvTransposed)(const float* weights, const float* input, float* output, int rows, int cols);
+		// outputs[b * rows + r] = weights[r] . inputs[b] + biases[r] for every sample b
+		void (*gemm)(const float* weights, const float* inputs, const float* biases, float* outputs, int rows, int cols, int batch);
+		// outputs[b * cols + c] = sum over r of weights[r * cols + c] * inputs[b * rows + r] for every sample b
+		void (*gemmTransposed)(const float* weights, const float* inputs, float* outputs, int rows, int cols, int batch);
+		// gradients[r * cols + c] += sum over b of deltas[b * rows + r] * inputs[b * cols + c]
+		void (*outerAccumulate)(float* gradients, const float* deltas, const float* inputs, int rows, int cols, int batch);
+		// y += scale * x
+		void (*axpy)(float* y, const float* x, float scale, int n);
+		void (*activate)(ACTFUNC actfunc, float* values, int n);
+		// error[i] *= derivative of the activation at outputs[i]
+		void (*derivative)(ACTFUNC actfunc, const float* outputs, float* error, int n);
+		// output[r] = weights[r] . input in 32 bit integers, rows and cols are multiples of QUANT_PADDING
+		void (*gemvInt8)(const signed char* weights, const signed char* input, int* output, int rows, int cols);
+		// values[i] += column[i], n is a multiple of QUANT_PADDING
+		void (*addInt16)(int* values, const short* column, int n);
+	};
+
+	// Kernels of the widest instruction set the CPU supports and that agree with the scalar kernels within KERNEL_TOLERANCE
+	const KernelTable& kernels();
+	// Tables compiled into this build, or nullptr when the instruction set was not enabled for its translation unit
+	const KernelTable* kernelTable(SimdLevel level);
+	bool cpuSupports(SimdLevel level);
+	const char* simdLevelName(SimdLevel level);
+	// Runs both tables on the same pseudo random data and returns their largest relative difference
+	float compareKernels(const KernelTable& reference, const KernelTable& candidate);
+
+	const KernelTable* sse42Kernels();
+	const KernelTable* avx2Kernels();
+	const KernelTable* avx512Kernels();
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+// Compiled with AVX2 and FMA enabled, the table is only used on CPUs that report support for both
+#include "Kernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#include "KernelsSimd.h"
+
+namespace AnnUtilities
+{
+	struct Avx2
+	{
+		typedef __m256 V;
+		static const int WIDTH = 8;
+		static V zero() { return _mm256_setzero_ps(); }
+		static V set1(float x) { return _mm256_set1_ps(x); }
+		static V load(const float* p) { return _mm256_loadu_ps(p); }
+		static void store(float* p, V v) { _mm256_storeu_ps(p, v); }
+		static V add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+		static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V div(V a, V b) { return _mm256_div_ps(a, b); }
+		static V fmadd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+		static V min(V a, V b) { return _mm256_min_ps(a, b); }
+		static V max(V a, V b) { return _mm256_max_ps(a, b); }
+		static V round(V a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+		static V pow2(V n) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23)); }
+		static V step(V a) { return _mm256_and_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GT_OQ), _mm256_set1_ps(1.0f)); }
+		static float sum(V a)
+		{
+			__m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+			s = _mm_hadd_ps(s, s);
+			s = _mm_hadd_ps(s, s);
+			return _mm_cvtss_f32(s);
+		}
+
+		typedef __m256i I;
+		static const int INT8_WIDTH = 16;
+		static const int INT32_WIDTH = 8;
+		static I izero() { return _mm256_setzero_si256(); }
+		static I iload(const int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+		static void istore(int* p, I v) { _mm256_storeu_si256((__m256i*)p, v); }
+		static I iadd(I a, I b) { return _mm256_add_epi32(a, b); }
+		static I imadd(I a, I b) { return _mm256_madd_epi16(a, b); }
+		static I widen8(const signed char* p) { return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)p)); }
+		static I widen16(const short* p) { return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)p)); }
+		static int isum(I a)
+		{
+			__m128i s = _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+			s = _mm_hadd_epi32(s, s);
+			s = _mm_hadd_epi32(s, s);
+			return _mm_cvtsi128_si32(s);
+		}
+	};
+
+	const KernelTable* avx2Kernels()
+	{
+		static const KernelTable table = SimdKernels<Avx2>::table(SimdLevel::AVX2);
+		return &table;
+	}
+}
+#else
+namespace AnnUtilities
+{
+	const KernelTable* avx2Kernels()
+	{
+		return nullptr;
+	}
+}
+#endif
\ No newline at end of file
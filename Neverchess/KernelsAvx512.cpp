@@ -0,0 +1,57 @@
+// Compiled with AVX-512F and AVX-512BW enabled, the table is only used on CPUs that report support for both
+#include "Kernels.h"
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#include <immintrin.h>
+#include "KernelsSimd.h"
+
+namespace AnnUtilities
+{
+	struct Avx512
+	{
+		typedef __m512 V;
+		static const int WIDTH = 16;
+		static V zero() { return _mm512_setzero_ps(); }
+		static V set1(float x) { return _mm512_set1_ps(x); }
+		static V load(const float* p) { return _mm512_loadu_ps(p); }
+		static void store(float* p, V v) { _mm512_storeu_ps(p, v); }
+		static V add(V a, V b) { return _mm512_add_ps(a, b); }
+		static V sub(V a, V b) { return _mm512_sub_ps(a, b); }
+		static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+		static V div(V a, V b) { return _mm512_div_ps(a, b); }
+		static V fmadd(V a, V b, V c) { return _mm512_fmadd_ps(a, b, c); }
+		static V min(V a, V b) { return _mm512_min_ps(a, b); }
+		static V max(V a, V b) { return _mm512_max_ps(a, b); }
+		static V round(V a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+		static V pow2(V n) { return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23)); }
+		static V step(V a) { return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a, _mm512_setzero_ps(), _CMP_GT_OQ), _mm512_set1_ps(1.0f)); }
+		static float sum(V a) { return _mm512_reduce_add_ps(a); }
+
+		typedef __m512i I;
+		static const int INT8_WIDTH = 32;
+		static const int INT32_WIDTH = 16;
+		static I izero() { return _mm512_setzero_si512(); }
+		static I iload(const int* p) { return _mm512_loadu_si512(p); }
+		static void istore(int* p, I v) { _mm512_storeu_si512(p, v); }
+		static I iadd(I a, I b) { return _mm512_add_epi32(a, b); }
+		static I imadd(I a, I b) { return _mm512_madd_epi16(a, b); }
+		static I widen8(const signed char* p) { return _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i*)p)); }
+		static I widen16(const short* p) { return _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)p)); }
+		static int isum(I a) { return _mm512_reduce_add_epi32(a); }
+	};
+
+	const KernelTable* avx512Kernels()
+	{
+		static const KernelTable table = SimdKernels<Avx512>::table(SimdLevel::AVX512);
+		return &table;
+	}
+}
+#else
+namespace AnnUtilities
+{
+	const KernelTable* avx512Kernels()
+	{
+		return nullptr;
+	}
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,358 @@
+#pragma once
+#include "Kernels.h"
+
+// Kernel bodies shared by the instruction set specific translation units. Each unit is compiled with its own
+// instruction set enabled and instantiates SimdKernels with a traits struct S wrapping the intrinsics:
+// V, WIDTH, zero, set1, load, store, add, sub, mul, div, fmadd, min, max, round, pow2, step and sum for floats and
+// I, INT8_WIDTH, INT32_WIDTH, izero, iload, istore, iadd, imadd, isum, widen8 and widen16 for integers.
+namespace AnnUtilities
+{
+	template <class S>
+	struct SimdKernels
+	{
+		typedef typename S::V V;
+		typedef typename S::I I;
+
+		// Cephes style exp: 2^n * p(r) with the argument clamped so that 2^n stays a normal float
+		static V exp(V x)
+		{
+			x = S::min(x, S::set1(88.0f));
+			x = S::max(x, S::set1(-87.0f));
+			V n = S::round(S::mul(x, S::set1(1.44269504088896341f)));
+			x = S::sub(x, S::mul(n, S::set1(0.693359375f)));
+			x = S::sub(x, S::mul(n, S::set1(-2.12194440e-4f)));
+			V z = S::mul(x, x);
+			V y = S::set1(1.9875691500e-4f);
+			y = S::fmadd(y, x, S::set1(1.3981999507e-3f));
+			y = S::fmadd(y, x, S::set1(8.3334519073e-3f));
+			y = S::fmadd(y, x, S::set1(4.1665795894e-2f));
+			y = S::fmadd(y, x, S::set1(1.6666665459e-1f));
+			y = S::fmadd(y, x, S::set1(5.0000001201e-1f));
+			y = S::fmadd(y, z, S::add(x, S::set1(1.0f)));
+			return S::mul(y, S::pow2(n));
+		}
+
+		static V sigmoid(V x)
+		{
+			V one = S::set1(1.0f);
+			return S::div(one, S::add(one, exp(S::sub(S::zero(), x))));
+		}
+
+		static V tanh(V x)
+		{
+			V one = S::set1(1.0f);
+			return S::sub(one, S::div(S::set1(2.0f), S::add(exp(S::add(x, x)), one)));
+		}
+
+		// Dot products of NB samples with NR weight rows, all NB * NR sums are kept in registers
+		template <int NB, int NR>
+		static void tile(const float* weights, const float* inputs, const float* biases, float* outputs, int rows, int cols, int b, int r)
+		{
+			V acc[NB][NR];
+			for (int i = 0; i < NB; ++i)
+			{
+				for (int j = 0; j < NR; ++j)
+				{
+					acc[i][j] = S::zero();
+				}
+			}
+			int c = 0;
+			for (; c + S::WIDTH <= cols; c += S::WIDTH)
+			{
+				V w[NR];
+				for (int j = 0; j < NR; ++j)
+				{
+					w[j] = S::load(weights + (r + j) * cols + c);
+				}
+				for (int i = 0; i < NB; ++i)
+				{
+					V x = S::load(inputs + (b + i) * cols + c);
+					for (int j = 0; j < NR; ++j)
+					{
+						acc[i][j] = S::fmadd(w[j], x, acc[i][j]);
+					}
+				}
+			}
+			for (int i = 0; i < NB; ++i)
+			{
+				for (int j = 0; j < NR; ++j)
+				{
+					float sum = S::sum(acc[i][j]);
+					for (int k = c; k < cols; ++k)
+					{
+						sum += weights[(r + j) * cols + k] * inputs[(b + i) * cols + k];
+					}
+					outputs[(b + i) * rows + r + j] = biases != nullptr ? sum + biases[r + j] : sum;
+				}
+			}
+		}
+
+		template <int NB>
+		static void tileRows(const float* weights, const float* inputs, const float* biases, float* outputs, int rows, int cols, int b)
+		{
+			int r = 0;
+			for (; r + 4 <= rows; r += 4)
+			{
+				tile<NB, 4>(weights, inputs, biases, outputs, rows, cols, b, r);
+			}
+			for (; r < rows; ++r)
+			{
+				tile<NB, 1>(weights, inputs, biases, outputs, rows, cols, b, r);
+			}
+		}
+
+		static void gemm(const float* weights, const float* inputs, const float* biases, float* outputs, int rows, int cols, int batch)
+		{
+			int b = 0;
+			for (; b + 2 <= batch; b += 2)
+			{
+				tileRows<2>(weights, inputs, biases, outputs, rows, cols, b);
+			}
+			for (; b < batch; ++b)
+			{
+				tileRows<1>(weights, inputs, biases, outputs, rows, cols, b);
+			}
+		}
+
+		static void gemv(const float* weights, const float* input, const float* biases, float* output, int rows, int cols)
+		{
+			tileRows<1>(weights, input, biases, output, rows, cols, 0);
+		}
+
+		static void gemvTransposed(const float* weights, const float* input, float* output, int rows, int cols)
+		{
+			for (int c = 0; c < cols; ++c)
+			{
+				output[c] = 0.0f;
+			}
+			int r = 0;
+			for (; r + 4 <= rows; r += 4)
+			{
+				const float* w0 = weights + r * cols;
+				const float* w1 = w0 + cols;
+				const float* w2 = w1 + cols;
+				const float* w3 = w2 + cols;
+				V x0 = S::set1(input[r]);
+				V x1 = S::set1(input[r + 1]);
+				V x2 = S::set1(input[r + 2]);
+				V x3 = S::set1(input[r + 3]);
+				int c = 0;
+				for (; c + S::WIDTH <= cols; c += S::WIDTH)
+				{
+					V o = S::load(output + c);
+					o = S::fmadd(S::load(w0 + c), x0, o);
+					o = S::fmadd(S::load(w1 + c), x1, o);
+					o = S::fmadd(S::load(w2 + c), x2, o);
+					o = S::fmadd(S::load(w3 + c), x3, o);
+					S::store(output + c, o);
+				}
+				for (; c < cols; ++c)
+				{
+					output[c] += w0[c] * input[r] + w1[c] * input[r + 1] + w2[c] * input[r + 2] + w3[c] * input[r + 3];
+				}
+			}
+			for (; r < rows; ++r)
+			{
+				axpy(output, weights + r * cols, input[r], cols);
+			}
+		}
+
+		static void gemmTransposed(const float* weights, const float* inputs, float* outputs, int rows, int cols, int batch)
+		{
+			for (int b = 0; b < batch; ++b)
+			{
+				gemvTransposed(weights, inputs + b * rows, outputs + b * cols, rows, cols);
+			}
+		}
+
+		static void outerAccumulate(float* gradients, const float* deltas, const float* inputs, int rows, int cols, int batch)
+		{
+			int r = 0;
+			for (; r + 4 <= rows; r += 4)
+			{
+				float* g0 = gradients + r * cols;
+				float* g1 = g0 + cols;
+				float* g2 = g1 + cols;
+				float* g3 = g2 + cols;
+				int c = 0;
+				for (; c + S::WIDTH <= cols; c += S::WIDTH)
+				{
+					V a0 = S::load(g0 + c);
+					V a1 = S::load(g1 + c);
+					V a2 = S::load(g2 + c);
+					V a3 = S::load(g3 + c);
+					for (int b = 0; b < batch; ++b)
+					{
+						V x = S::load(inputs + b * cols + c);
+						const float* d = deltas + b * rows + r;
+						a0 = S::fmadd(S::set1(d[0]), x, a0);
+						a1 = S::fmadd(S::set1(d[1]), x, a1);
+						a2 = S::fmadd(S::set1(d[2]), x, a2);
+						a3 = S::fmadd(S::set1(d[3]), x, a3);
+					}
+					S::store(g0 + c, a0);
+					S::store(g1 + c, a1);
+					S::store(g2 + c, a2);
+					S::store(g3 + c, a3);
+				}
+				for (; c < cols; ++c)
+				{
+					for (int b = 0; b < batch; ++b)
+					{
+						const float* d = deltas + b * rows + r;
+						float x = inputs[b * cols + c];
+						g0[c] += d[0] * x;
+						g1[c] += d[1] * x;
+						g2[c] += d[2] * x;
+						g3[c] += d[3] * x;
+					}
+				}
+			}
+			for (; r < rows; ++r)
+			{
+				for (int b = 0; b < batch; ++b)
+				{
+					axpy(gradients + r * cols, inputs + b * cols, deltas[b * rows + r], cols);
+				}
+			}
+		}
+
+		static void axpy(float* y, const float* x, float scale, int n)
+		{
+			V s = S::set1(scale);
+			int i = 0;
+			for (; i + S::WIDTH <= n; i += S::WIDTH)
+			{
+				S::store(y + i, S::fmadd(S::load(x + i), s, S::load(y + i)));
+			}
+			for (; i < n; ++i)
+			{
+				y[i] += scale * x[i];
+			}
+		}
+
+		static V activation(ACTFUNC actfunc, V x)
+		{
+			switch (actfunc)
+			{
+			case ACTFUNC::SIGMOID:
+				return sigmoid(x);
+			case ACTFUNC::RELU:
+				return S::max(x, S::zero());
+			case ACTFUNC::LEAKY_RELU:
+				return S::max(x, S::mul(x, S::set1(0.01f)));
+			case ACTFUNC::TANH:
+				return tanh(x);
+			}
+			return x;
+		}
+
+		static V slope(ACTFUNC actfunc, V y)
+		{
+			switch (actfunc)
+			{
+			case ACTFUNC::SIGMOID:
+				return S::mul(y, S::sub(S::set1(1.0f), y));
+			case ACTFUNC::RELU:
+				return S::step(y);
+			case ACTFUNC::LEAKY_RELU:
+				return S::fmadd(S::step(y), S::set1(0.99f), S::set1(0.01f));
+			case ACTFUNC::TANH:
+				return S::sub(S::set1(1.0f), S::mul(y, y));
+			}
+			return S::set1(1.0f);
+		}
+
+		// The tail that does not fill a register goes through a zero padded register so it is computed the same way
+		static void activate(ACTFUNC actfunc, float* values, int n)
+		{
+			int i = 0;
+			for (; i + S::WIDTH <= n; i += S::WIDTH)
+			{
+				S::store(values + i, activation(actfunc, S::load(values + i)));
+			}
+			if (i < n)
+			{
+				float tail[S::WIDTH] = { 0.0f };
+				for (int j = i; j < n; ++j)
+				{
+					tail[j - i] = values[j];
+				}
+				S::store(tail, activation(actfunc, S::load(tail)));
+				for (int j = i; j < n; ++j)
+				{
+					values[j] = tail[j - i];
+				}
+			}
+		}
+
+		static void derivative(ACTFUNC actfunc, const float* outputs, float* error, int n)
+		{
+			int i = 0;
+			for (; i + S::WIDTH <= n; i += S::WIDTH)
+			{
+				S::store(error + i, S::mul(S::load(error + i), slope(actfunc, S::load(outputs + i))));
+			}
+			if (i < n)
+			{
+				float tail[S::WIDTH] = { 0.0f };
+				for (int j = i; j < n; ++j)
+				{
+					tail[j - i] = outputs[j];
+				}
+				S::store(tail, slope(actfunc, S::load(tail)));
+				for (int j = i; j < n; ++j)
+				{
+					error[j] *= tail[j - i];
+				}
+			}
+		}
+
+		// int8 values are widened to int16 so that imadd multiplies and adds pairs into int32 lanes without saturating
+		static void gemvInt8(const signed char* weights, const signed char* input, int* output, int rows, int cols)
+		{
+			for (int r = 0; r < rows; r += 4)
+			{
+				const signed char* w = weights + r * cols;
+				I acc[4] = { S::izero(), S::izero(), S::izero(), S::izero() };
+				for (int c = 0; c < cols; c += S::INT8_WIDTH)
+				{
+					I x = S::widen8(input + c);
+					for (int j = 0; j < 4; ++j)
+					{
+						acc[j] = S::iadd(acc[j], S::imadd(S::widen8(w + j * cols + c), x));
+					}
+				}
+				for (int j = 0; j < 4; ++j)
+				{
+					output[r + j] = S::isum(acc[j]);
+				}
+			}
+		}
+
+		static void addInt16(int* values, const short* column, int n)
+		{
+			for (int i = 0; i < n; i += S::INT32_WIDTH)
+			{
+				S::istore(values + i, S::iadd(S::iload(values + i), S::widen16(column + i)));
+			}
+		}
+
+		static KernelTable table(SimdLevel level)
+		{
+			KernelTable t;
+			t.level = level;
+			t.gemv = &gemv;
+			t.gemvTransposed = &gemvTransposed;
+			t.gemm = &gemm;
+			t.gemmTransposed = &gemmTransposed;
+			t.outerAccumulate = &outerAccumulate;
+			t.axpy = &axpy;
+			t.activate = &activate;
+			t.derivative = &derivative;
+			t.gemvInt8 = &gemvInt8;
+			t.addInt16 = &addInt16;
+			return t;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+// Compiled with SSE 4.2 enabled, the table is only used on CPUs that report support for it
+#include "Kernels.h"
+
+#if defined(__SSE4_2__) || defined(_M_X64)
+#include <immintrin.h>
+#include "KernelsSimd.h"
+
+namespace AnnUtilities
+{
+	struct Sse42
+	{
+		typedef __m128 V;
+		static const int WIDTH = 4;
+		static V zero() { return _mm_setzero_ps(); }
+		static V set1(float x) { return _mm_set1_ps(x); }
+		static V load(const float* p) { return _mm_loadu_ps(p); }
+		static void store(float* p, V v) { _mm_storeu_ps(p, v); }
+		static V add(V a, V b) { return _mm_add_ps(a, b); }
+		static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+		static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+		static V div(V a, V b) { return _mm_div_ps(a, b); }
+		static V fmadd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+		static V min(V a, V b) { return _mm_min_ps(a, b); }
+		static V max(V a, V b) { return _mm_max_ps(a, b); }
+		static V round(V a) { return _mm_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+		static V pow2(V n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23)); }
+		static V step(V a) { return _mm_and_ps(_mm_cmpgt_ps(a, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+		static float sum(V a)
+		{
+			a = _mm_hadd_ps(a, a);
+			a = _mm_hadd_ps(a, a);
+			return _mm_cvtss_f32(a);
+		}
+
+		typedef __m128i I;
+		static const int INT8_WIDTH = 8;
+		static const int INT32_WIDTH = 4;
+		static I izero() { return _mm_setzero_si128(); }
+		static I iload(const int* p) { return _mm_loadu_si128((const __m128i*)p); }
+		static void istore(int* p, I v) { _mm_storeu_si128((__m128i*)p, v); }
+		static I iadd(I a, I b) { return _mm_add_epi32(a, b); }
+		static I imadd(I a, I b) { return _mm_madd_epi16(a, b); }
+		static I widen8(const signed char* p) { return _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i*)p)); }
+		static I widen16(const short* p) { return _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)p)); }
+		static int isum(I a)
+		{
+			a = _mm_hadd_epi32(a, a);
+			a = _mm_hadd_epi32(a, a);
+			return _mm_cvtsi128_si32(a);
+		}
+	};
+
+	const KernelTable* sse42Kernels()
+	{
+		static const KernelTable table = SimdKernels<Sse42>::table(SimdLevel::SSE42);
+		return &table;
+	}
+}
+#else
+namespace AnnUtilities
+{
+	const KernelTable* sse42Kernels()
+	{
+		return nullptr;
+	}
+}
+#endif
\ No newline at end of file
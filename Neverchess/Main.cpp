@@ -6,17 +6,224 @@
 #include <exception>
 #include <fstream>
 #include <exception>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
 
 #include "BoardState.h"
+#include "SelfPlay.h"
+#include "GameLog.h"
+#include "PositionImport.h"
+#include "Analysis.h"
+#include "Match.h"
+#include "Uci.h"
 #include "MoveData.h"
+#include "Kernels.h"
 
 
-int main()
+static const int TRAINING_GAMES = 12500;
+// Games between checkpoints, a killed run resumes from the last one. A checkpoint is written once the number of
+// trained games passes a multiple of this.
+static const int CHECKPOINT_INTERVAL = 25;
+static const char* CHECKPOINT_FILE = "training.checkpoint";
+// Every game the learner trains on is appended here
+static const char* GAME_LOG_FILE = "selfplay.games";
+// Positions from EPD files between two trainings, about as many as a self-play game adds
+static const int IMPORT_POSITIONS_PER_TRAINING = 80;
+static const char* IMPORT_MODEL_FILE = "imported.model";
+// Self-play games of the bench workload when none are given
+static const int BENCH_GAMES = 4;
+
+struct Milestone
+{
+	int games;
+	const char* fileName;
+};
+
+static const Milestone MILESTONES[] = { { 100, "ann100.model" }, { 500, "ann500.model" }, { 2500, "ann2500.model" }, { 12500, "ann10000.model" } };
+
+// Audited games and how many of them adjudication would have given the wrong result
+static int auditedGames = 0;
+static int adjudicationErrors = 0;
+
+static void addPlayedGame(BoardState::BoardManager& manager, BoardState::GameLogWriter& gameLog, const BoardState::PlayedGame& played, int games)
+{
+	std::cout << games << "th game: " << played.moves.size() << " moves, white win = " << played.whiteWin
+		<< ", black win = " << played.blackWin << ", " << BoardState::gameEndName(played.ending) << std::endl;
+	if (played.audited)
+	{
+		BoardState::GameResult result = played.whiteWin ? BoardState::GameResult::WHITE_WIN : played.blackWin ? BoardState::GameResult::BLACK_WIN : BoardState::GameResult::DRAW;
+		++auditedGames;
+		adjudicationErrors += result != played.adjudicatedResult;
+		std::cout << "Adjudication audit: " << adjudicationErrors << " of " << auditedGames << " adjudications wrong" << std::endl;
+	}
+	manager.addGame(played);
+	gameLog.write(played);
+}
+
+// Exports the models of the milestones after before and up to games
+static void exportMilestones(AnnUtilities::ANNetwork& ann, BoardState::BoardManager& manager, int before, int games)
+{
+	for (const Milestone& milestone : MILESTONES)
+	{
+		if (milestone.games > before && milestone.games <= games)
+		{
+			manager.snapshotModel(ann, milestone.fileName);
+		}
+	}
+}
+
+// Self-play and training take turns: a round of one game per thread, then training on the round in the order its
+// games were started. The result does not depend on which thread finished first, so a resumed run is identical to
+// one that was never stopped.
+static void trainInRounds(AnnUtilities::ANNetwork& ann, BoardState::BoardManager& manager, BoardState::SelfPlay& selfPlay, BoardState::GameLogWriter& gameLog, int i)
+{
+	while (i < TRAINING_GAMES)
+	{
+		selfPlay.playRound(ann, std::min(selfPlay.threads(), TRAINING_GAMES - i));
+		std::vector<BoardState::PlayedGame> round;
+		BoardState::PlayedGame game;
+		while (selfPlay.games().tryPop(game))
+		{
+			round.push_back(std::move(game));
+		}
+		std::sort(round.begin(), round.end(), [](const BoardState::PlayedGame& a, const BoardState::PlayedGame& b) { return a.index < b.index; });
+		int checkpoints = i / CHECKPOINT_INTERVAL;
+		for (const BoardState::PlayedGame& played : round)
+		{
+			addPlayedGame(manager, gameLog, played, i);
+			manager.trainReplay(ann, manager.replayBatches());
+			++i;
+			exportMilestones(ann, manager, i - 1, i);
+		}
+
+		// Only between rounds, a resumed run has to start its rounds where the original run did
+		if (i / CHECKPOINT_INTERVAL != checkpoints)
+		{
+			gameLog.flush();
+			manager.snapshotCheckpoint(ann, i, CHECKPOINT_FILE);
+		}
+	}
+}
+
+// Actors play all the time while the learner trains on the replay buffer and publishes its weights once it has
+// trained the publish interval of batches and a game has finished since the last snapshot. Actors only pick up a
+// snapshot when they start a game, so publishing while none finished would only build copies nobody plays with.
+// Only the first game is waited for. Games reach the buffer in the order they finish, so these runs are not reproducible.
+static void trainAsync(AnnUtilities::ANNetwork& ann, BoardState::BoardManager& manager, BoardState::SelfPlay& selfPlay, BoardState::GameLogWriter& gameLog, int i)
+{
+	selfPlay.start(ann);
+	int checkpoints = i / CHECKPOINT_INTERVAL;
+	BoardState::PlayedGame played;
+	int published = i;
+	int trained = 0;
+	while (i < TRAINING_GAMES)
+	{
+		int before = i;
+		if (manager.replaySize() == 0)
+		{
+			played = selfPlay.games().pop();
+			addPlayedGame(manager, gameLog, played, i++);
+		}
+		while (i < TRAINING_GAMES && selfPlay.games().tryPop(played))
+		{
+			addPlayedGame(manager, gameLog, played, i++);
+		}
+		trained += manager.trainReplay(ann, std::max(1, manager.replayBatches()));
+		if (trained >= selfPlay.publishInterval() && i != published)
+		{
+			selfPlay.publish(ann);
+			published = i;
+			trained = 0;
+		}
+		exportMilestones(ann, manager, before, i);
+		if (i / CHECKPOINT_INTERVAL != checkpoints)
+		{
+			checkpoints = i / CHECKPOINT_INTERVAL;
+			gameLog.flush();
+			manager.snapshotCheckpoint(ann, i, CHECKPOINT_FILE);
+		}
+	}
+	selfPlay.stop();
+}
+
+// Supervised training on the games and positions of PGN and EPD files and on the game logs of earlier self-play
+// runs. Games train like self-play games, the checkpoint written at the end lets self-play continue from the imported
+// network and replay buffer.
+static void importPositions(AnnUtilities::ANNetwork& ann, BoardState::BoardManager& manager, const std::vector<std::string>& files, int threads, int games)
+{
+	BoardState::PositionImporter importer;
+	importer.init(threads);
+	long long positions = 0;
+	importer.setGameSink([&](const BoardState::PlayedGame& game)
+	{
+		manager.addGame(game);
+		manager.trainReplay(ann, manager.replayBatches());
+	});
+	importer.setPositionSink([&](const BoardState::BoardStateData& boardStateData, float label)
+	{
+		manager.addPosition(boardStateData, label);
+		if (++positions % IMPORT_POSITIONS_PER_TRAINING == 0)
+		{
+			manager.trainReplay(ann, manager.replayBatches());
+		}
+	});
+	for (const std::string& file : files)
+	{
+		BoardState::ImportStats stats = importer.importFile(file);
+		std::cout << file << ": " << stats.games << " games, " << stats.positions << " positions, " << stats.skipped
+			<< " skipped in " << stats.seconds << " s, " << (long long)stats.positionsPerSecond() << " positions/s" << std::endl;
+	}
+	manager.snapshotModel(ann, IMPORT_MODEL_FILE);
+	manager.snapshotCheckpoint(ann, games, CHECKPOINT_FILE);
+}
+
+// A fixed workload that touches every hot path: self-play games on one thread from the untrained network, each
+// followed by training on the replay buffer. Nothing is written, so it can drive profile guided builds.
+static void bench(AnnUtilities::ANNetwork& ann, BoardState::BoardManager& manager, int games)
+{
+	BoardState::SelfPlay selfPlay;
+	selfPlay.setSearch(2, 1000);
+	BoardState::AdjudicationSettings adjudication;
+	adjudication.enabled = true;
+	selfPlay.setAdjudication(adjudication);
+	selfPlay.init(1, manager);
+	manager.setTrainingThreads(1);
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	long long moves = 0;
+	BoardState::PlayedGame played;
+	for (int i = 0; i < games; ++i)
+	{
+		selfPlay.playRound(ann, 1);
+		played = selfPlay.games().pop();
+		moves += played.moves.size();
+		manager.addGame(played);
+		manager.trainReplay(ann, manager.replayBatches());
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::cout << "Bench: " << games << " games, " << moves << " moves in "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " ms" << std::endl;
+}
+
+// Reports how far the quantized network is from the float network over random playout positions
+static void quantizationCheck(AnnUtilities::ANNetwork& ann, BoardState::BoardManager& manager, int positions)
+{
+	BoardState::QuantizedNetwork quantized;
+	quantized.quantize(ann);
+	std::vector<BoardState::BoardStateData> boards = manager.samplePositions(positions, 1);
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	BoardState::QuantizationReport report = BoardState::validateQuantization(quantized, ann, boards);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::cout << "Quantized " << report.positions << " positions: mean error " << report.meanError
+		<< ", max error " << report.maxError << " in "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " ms" << std::endl;
+}
+
+int main(int argc, char* argv[])
 {
 	//srand(time(NULL));
 	AnnUtilities::ANNetwork ann;
 	BoardState::BoardManager manager;
-	BoardState::BoardStateData board;
 
 	AnnUtilities::ANNSettings annSettings;
 	annSettings._hiddenActicationFunction = AnnUtilities::ACTFUNC::TANH;
@@ -31,50 +238,179 @@ int main()
 
 	ann.Init();
 	manager.calculateZobristValues();
+	int threads = std::max(1, (int)std::thread::hardware_concurrency());
+	manager.setTrainingThreads(threads);
+	// uci [checkpoint], the engine protocol owns stdout, so nothing is printed before it
+	if (argc > 1 && std::string(argv[1]) == "uci")
+	{
+		std::string checkpoint = argc > 2 ? argv[2] : CHECKPOINT_FILE;
+		if (std::ifstream(checkpoint).good())
+		{
+			manager.loadCheckpoint(ann, checkpoint);
+		}
+		BoardState::UciEngine uci;
+		uci.init(ann, 1);
+		uci.loop(std::cin, std::cout);
+		return 0;
+	}
 
-	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-	try
+	std::cout << "Using " << AnnUtilities::simdLevelName(AnnUtilities::kernels().level) << " kernels" << std::endl;
+
+	// --quantized anywhere on the command line makes analyse and match search with the int8/int16 network,
+	// --mcts <playouts> makes self-play choose its moves with MCTS, --publish <batches> sets the training batches
+	// between two snapshots the self-play actors get
+	bool quantized = false;
+	int selfPlayPlayouts = 0;
+	int publishInterval = BoardState::SELF_PLAY_PUBLISH_INTERVAL;
+	for (int a = 1; a < argc; ++a)
 	{
-		int i = 0;
-		for (; i < 100; ++i)
+		int used = 0;
+		if (std::string(argv[a]) == "--quantized")
+		{
+			quantized = true;
+			used = 1;
+		}
+		else if (std::string(argv[a]) == "--mcts" && a + 1 < argc)
+		{
+			selfPlayPlayouts = std::max(1, atoi(argv[a + 1]));
+			used = 2;
+		}
+		else if (std::string(argv[a]) == "--publish" && a + 1 < argc)
 		{
-			std::cout << i << "th game" << std::endl;
-			manager.resetBoardStateData(board);
-			manager.process(board, ann, 2, 1000);
-			manager.train(ann);
-			manager.reset();
+			publishInterval = std::max(1, atoi(argv[a + 1]));
+			used = 2;
 		}
-		manager.exportANN(ann, "ann100.ann");
+		if (used > 0)
+		{
+			std::copy(argv + a + used, argv + argc, argv + a);
+			argc -= used;
+			--a;
+		}
+	}
 
-		for (; i < 500; ++i)
+	// analyse <positions> <results> [depth] [milliseconds] [network], a depth of 0 searches for the time only
+	if (argc > 3 && std::string(argv[1]) == "analyse")
+	{
+		if (argc > 6)
 		{
-			std::cout << i << "th game" << std::endl;
-			manager.resetBoardStateData(board);
-			manager.process(board, ann, 2, 1000);
-			manager.train(ann);
-			manager.reset();
+			manager.importANN(ann, argv[6]);
 		}
-		manager.exportANN(ann, "ann500.ann");
+		BoardState::BatchAnalysis analysis;
+		analysis.init(threads);
+		analysis.setSearch(argc > 4 ? atoi(argv[4]) : 4, argc > 5 ? atoi(argv[5]) : 0);
+		analysis.setQuantized(quantized);
+		BoardState::AnalysisSummary summary = analysis.run(ann, argv[2], argv[3]);
+		std::cout << summary.positions << " positions, " << summary.invalid << " invalid, " << summary.solved << " of "
+			<< summary.withBestMove << " best moves found, " << summary.nodes << " nodes in " << summary.seconds << " s" << std::endl;
+		return 0;
+	}
 
-		for (; i < 2500; ++i)
+	// match <model> <model> [games] [depth] [depth] [openings], the first model is the one under test. A depth of
+	// mcts:<playouts> plays that engine with MCTS instead of alpha-beta.
+	if (argc > 3 && std::string(argv[1]) == "match")
+	{
+		BoardState::MatchEngine engines[2];
+		for (int i = 0; i < 2; ++i)
 		{
-			std::cout << i << "th game" << std::endl;
-			manager.resetBoardStateData(board);
-			manager.process(board, ann, 2, 1000);
-			manager.train(ann);
-			manager.reset();
+			engines[i].name = argv[2 + i];
+			engines[i].weights = std::make_shared<const AnnUtilities::InferenceNetwork>(engines[i].name);
+			std::string search = argc > 5 + i ? argv[5 + i] : "2";
+			if (search.compare(0, 5, "mcts:") == 0)
+			{
+				engines[i].mode = BoardState::SearchMode::MCTS;
+				engines[i].playouts = std::max(1, atoi(search.c_str() + 5));
+			}
+			else
+			{
+				engines[i].depth = atoi(search.c_str());
+			}
+			if (quantized)
+			{
+				std::shared_ptr<BoardState::QuantizedNetwork> network = std::make_shared<BoardState::QuantizedNetwork>();
+				network->quantize(*engines[i].weights);
+				engines[i].quantized = network;
+			}
 		}
-		manager.exportANN(ann, "ann2500.ann");
+		BoardState::Match match;
+		match.init(threads);
+		if (argc > 7)
+		{
+			match.loadOpenings(argv[7]);
+		}
+		BoardState::MatchScore score = match.run(engines[0], engines[1], argc > 4 ? atoi(argv[4]) : 1000);
+		const char* results[] = { "no decision", "H0 accepted", "H1 accepted" };
+		std::cout << engines[0].name << " vs " << engines[1].name << ": +" << score.wins << " =" << score.draws << " -" << score.losses
+			<< ", Elo " << score.elo() << " +/- " << score.eloError() << ", SPRT " << results[(int)match.result()] << std::endl;
+		return 0;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "bench")
+	{
+		bench(ann, manager, argc > 2 ? atoi(argv[2]) : BENCH_GAMES);
+		return 0;
+	}
 
-		for (; i < 12500; ++i)
+	if (argc > 1 && std::string(argv[1]) == "quantcheck")
+	{
+		if (argc > 3)
+		{
+			manager.importANN(ann, argv[3]);
+		}
+		quantizationCheck(ann, manager, argc > 2 ? atoi(argv[2]) : 10000);
+		return 0;
+	}
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	try
+	{
+		int i = 0;
+		bool resumed = std::ifstream(CHECKPOINT_FILE).good();
+		if (resumed)
+		{
+			i = manager.loadCheckpoint(ann, CHECKPOINT_FILE);
+			std::cout << "Resuming after game " << i << std::endl;
+		}
+		if (argc > 2 && std::string(argv[1]) == "import")
+		{
+			importPositions(ann, manager, std::vector<std::string>(argv + 2, argv + argc), threads, i);
+		}
+		else
 		{
-			std::cout << i << "th game" << std::endl;
-			manager.resetBoardStateData(board);
-			manager.process(board, ann, 2, 1000);
-			manager.train(ann);
-			manager.reset();
+			// A resumed run keeps the logged games the checkpoint has trained on, the ones after them are played again
+			BoardState::GameLogWriter gameLog;
+			if (resumed)
+			{
+				gameLog.open(GAME_LOG_FILE, i);
+			}
+			else
+			{
+				gameLog.open(GAME_LOG_FILE);
+			}
+			BoardState::SelfPlay selfPlay;
+			selfPlay.setSearch(2, 1000);
+			selfPlay.setPublishInterval(publishInterval);
+			if (selfPlayPlayouts > 0)
+			{
+				selfPlay.setSearchMode(BoardState::SearchMode::MCTS, selfPlayPlayouts);
+			}
+			BoardState::AdjudicationSettings adjudication;
+			adjudication.enabled = true;
+			selfPlay.setAdjudication(adjudication);
+			if (argc > 1 && std::string(argv[1]) == "rounds")
+			{
+				selfPlay.init(threads, manager);
+				trainInRounds(ann, manager, selfPlay, gameLog, i);
+			}
+			else
+			{
+				// One thread is left to the learner
+				selfPlay.init(threads - 1, manager);
+				manager.setTrainingThreads(1);
+				trainAsync(ann, manager, selfPlay, gameLog, i);
+			}
+			gameLog.close();
 		}
-		manager.exportANN(ann, "ann10000.ann");
+		manager.flushSnapshots();
 	}
 	catch (std::exception e)
 	{
@@ -0,0 +1,310 @@
+#include "Match.h"
+#include "Fen.h"
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <thread>
+#include <stdexcept>
+#include <unordered_map>
+#include <algorithm>
+
+namespace BoardState
+{
+	// Common main lines that leave both sides with a playable game
+	static const char* DEFAULT_OPENINGS[] =
+	{
+		"e4 e5 Nf3 Nc6 Bb5 a6",
+		"e4 e5 Nf3 Nc6 Bc4 Bc5 c3 Nf6",
+		"e4 e5 Nf3 Nf6 Nxe5 d6 Nf3 Nxe4",
+		"e4 c5 Nf3 d6 d4 cxd4 Nxd4 Nf6 Nc3",
+		"e4 c5 Nc3 Nc6 g3 g6 Bg2 Bg7",
+		"e4 e6 d4 d5 Nc3 Nf6",
+		"e4 c6 d4 d5 Nc3 dxe4 Nxe4",
+		"e4 d6 d4 Nf6 Nc3 g6",
+		"d4 d5 c4 e6 Nc3 Nf6",
+		"d4 d5 c4 c6 Nf3 Nf6 Nc3 dxc4",
+		"d4 Nf6 c4 g6 Nc3 Bg7 e4 d6",
+		"d4 Nf6 c4 e6 Nc3 Bb4",
+		"d4 Nf6 Nf3 e6 Bg5 c5",
+		"d4 f5 g3 Nf6 Bg2 e6",
+		"c4 e5 Nc3 Nf6 Nf3 Nc6",
+		"Nf3 d5 g3 Nf6 Bg2 c6"
+	};
+
+	static double eloFromScore(double score)
+	{
+		score = std::min(std::max(score, 1e-6), 1.0 - 1e-6);
+		return 400.0 * log10(score / (1.0 - score));
+	}
+
+	static double scoreFromElo(double elo)
+	{
+		return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+	}
+
+	double MatchScore::score() const
+	{
+		return games() > 0 ? (wins + 0.5 * draws) / games() : 0.5;
+	}
+
+	// Variance of the score of a single game
+	static double gameVariance(const MatchScore& matchScore)
+	{
+		double s = matchScore.score();
+		return (matchScore.wins * (1.0 - s) * (1.0 - s) + matchScore.draws * (0.5 - s) * (0.5 - s) + matchScore.losses * s * s) / matchScore.games();
+	}
+
+	double MatchScore::elo() const
+	{
+		return eloFromScore(score());
+	}
+
+	double MatchScore::eloError() const
+	{
+		if (games() == 0)
+		{
+			return 0.0;
+		}
+		double margin = 1.959964 * sqrt(gameVariance(*this) / games());
+		return (eloFromScore(score() + margin) - eloFromScore(score() - margin)) * 0.5;
+	}
+
+	int MatchScore::pairCount() const
+	{
+		return pairs[0] + pairs[1] + pairs[2] + pairs[3] + pairs[4];
+	}
+
+	// Each pair scores its mean game score, 0, 1/4, 1/2, 3/4 or 1
+	double MatchScore::llr(const SprtSettings& sprt) const
+	{
+		int count = pairCount();
+		if (count == 0)
+		{
+			return 0.0;
+		}
+		double mean = 0.0;
+		for (int points = 0; points < 5; ++points)
+		{
+			mean += pairs[points] * points * 0.25;
+		}
+		mean /= count;
+		double variance = 0.0;
+		for (int points = 0; points < 5; ++points)
+		{
+			variance += pairs[points] * (points * 0.25 - mean) * (points * 0.25 - mean);
+		}
+		variance /= count;
+		if (variance <= 0.0)
+		{
+			return 0.0;
+		}
+		double s0 = scoreFromElo(sprt.elo0);
+		double s1 = scoreFromElo(sprt.elo1);
+		return count * (s1 - s0) * (2.0 * mean - s0 - s1) / (2.0 * variance);
+	}
+
+	void Match::init(int threads)
+	{
+		workers.resize(2 * std::max(1, threads));
+		for (std::unique_ptr<BoardManager>& worker : workers)
+		{
+			if (!worker)
+			{
+				worker.reset(new BoardManager());
+				worker->calculateZobristValues();
+				worker->setVerbose(false);
+				// Games run side by side, so a search keeps to its own thread
+				worker->setSearchThreads(1);
+			}
+		}
+	}
+
+	void Match::defaultOpenings()
+	{
+		BoardManager manager;
+		openings.clear();
+		for (const char* line : DEFAULT_OPENINGS)
+		{
+			BoardStateData boardStateData;
+			manager.resetBoardStateData(boardStateData);
+			std::istringstream moves(line);
+			std::string san;
+			MoveData move;
+			while (moves >> san)
+			{
+				if (!manager.parseSan(boardStateData, san, move))
+				{
+					throw std::logic_error(std::string("Opening is not legal: ") + line);
+				}
+				applyMove(boardStateData, move);
+			}
+			openings.push_back(boardStateData);
+		}
+	}
+
+	void Match::loadOpenings(const std::string& fileName)
+	{
+		std::ifstream in(fileName);
+		if (!in)
+		{
+			throw std::runtime_error(fileName + ": could not open file");
+		}
+		openings.clear();
+		std::string line;
+		BoardStateData boardStateData;
+		while (std::getline(in, line))
+		{
+			if (parseFen(line, boardStateData))
+			{
+				openings.push_back(boardStateData);
+			}
+		}
+		if (openings.empty())
+		{
+			throw std::runtime_error(fileName + ": no openings");
+		}
+	}
+
+	// Plays an opening to the end, white is the index of the engine with the white pieces
+	GameResult Match::playGame(BoardManager* players[2], const BoardStateData& opening, int white)
+	{
+		BoardStateData boardStateData;
+		boardStateData.copy(opening);
+		std::unordered_map<std::string, int> positions;
+		for (int ply = 0; ply < MATCH_MAX_PLIES && !stopped; ++ply)
+		{
+			int side = boardStateData._turn ? 1 - white : white;
+			BoardManager& player = *players[side];
+			if (player.legalMoves(boardStateData).empty())
+			{
+				return !player.inCheck(boardStateData) ? GameResult::DRAW : boardStateData._turn ? GameResult::WHITE_WIN : GameResult::BLACK_WIN;
+			}
+			// The clock is not part of the position, only the board, side, castling and en passant fields are
+			std::string fen = writeFen(boardStateData);
+			if (++positions[fen.substr(0, fen.rfind(' ', fen.rfind(' ') - 1))] >= 3 || boardStateData._halfmoveClock >= FIFTY_MOVE_PLIES
+				|| insufficientMaterial(boardStateData))
+			{
+				return GameResult::DRAW;
+			}
+			player.reset();
+			MatchEngine& engine = *engines[side];
+			MoveData move;
+			if (engine.mode == SearchMode::MCTS)
+			{
+				move = player.mcts(boardStateData, engine.identity, engine.playouts).move;
+			}
+			else
+			{
+				move = player.iterativeSearch(boardStateData, engine.identity, engine.depth > 0 ? engine.depth : MAX_SEARCH_PLY, engine.milliseconds).evaluation.move;
+			}
+			applyMove(boardStateData, move);
+		}
+		return GameResult::DRAW;
+	}
+
+	void Match::addResult(int game, GameResult result)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		bool firstWhite = game % 2 == 0;
+		if (result == GameResult::DRAW)
+		{
+			++score.draws;
+			pairPoints[game / 2] += 1;
+		}
+		else if ((result == GameResult::WHITE_WIN) == firstWhite)
+		{
+			++score.wins;
+			pairPoints[game / 2] += 2;
+		}
+		else
+		{
+			++score.losses;
+		}
+		// The test only looks at whole pairs, so neither colour is ahead in the games it counts
+		bool pairDone = ++pairGames[game / 2] == 2;
+		if (pairDone)
+		{
+			++score.pairs[pairPoints[game / 2]];
+		}
+		if (score.games() % MATCH_REPORT_INTERVAL == 0)
+		{
+			std::cout << "Games " << score.games() << ": +" << score.wins << " =" << score.draws << " -" << score.losses
+				<< ", Elo " << score.elo() << " +/- " << score.eloError() << ", LLR " << score.llr(sprt) << " over " << score.pairCount() << " pairs" << std::endl;
+		}
+
+		if (pairDone && decision == SprtDecision::CONTINUE)
+		{
+			double llr = score.llr(sprt);
+			if (llr <= log(sprt.beta / (1.0 - sprt.alpha)))
+			{
+				decision = SprtDecision::ACCEPT_H0;
+			}
+			else if (llr >= log((1.0 - sprt.beta) / sprt.alpha))
+			{
+				decision = SprtDecision::ACCEPT_H1;
+			}
+			stopped = decision != SprtDecision::CONTINUE;
+		}
+	}
+
+	void Match::play(BoardManager* players[2], std::atomic<int>& next, int games)
+	{
+		int game;
+		while (!stopped && (game = next++) < games)
+		{
+			GameResult result = playGame(players, openings[(game / 2) % openings.size()], game % 2);
+			// A game the test stopped is not finished
+			if (!stopped)
+			{
+				addResult(game, result);
+			}
+		}
+	}
+
+	// Plays up to games games, rounded up to whole pairs, or until the SPRT accepts a hypothesis
+	MatchScore Match::run(MatchEngine& first, MatchEngine& second, int games)
+	{
+		if (workers.empty())
+		{
+			init(1);
+		}
+		if (openings.empty())
+		{
+			defaultOpenings();
+		}
+		engines[0] = &first;
+		engines[1] = &second;
+		for (unsigned int i = 0; i < workers.size(); i += 2)
+		{
+			workers[i]->shareNetwork(first.identity, first.weights);
+			workers[i + 1]->shareNetwork(second.identity, second.weights);
+			workers[i]->setQuantizedNetwork(first.quantized.get());
+			workers[i + 1]->setQuantizedNetwork(second.quantized.get());
+		}
+		games += games % 2;
+		score = MatchScore();
+		pairGames.assign(games / 2, 0);
+		pairPoints.assign(games / 2, 0);
+		decision = SprtDecision::CONTINUE;
+		stopped = false;
+
+		std::atomic<int> next(0);
+		std::vector<std::thread> threads;
+		for (unsigned int i = 2; i < workers.size(); i += 2)
+		{
+			threads.push_back(std::thread([this, i, &next, games]()
+			{
+				BoardManager* players[2] = { workers[i].get(), workers[i + 1].get() };
+				play(players, next, games);
+			}));
+		}
+		BoardManager* players[2] = { workers[0].get(), workers[1].get() };
+		play(players, next, games);
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+		return score;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <ANNetwork.h>
+#include "BoardState.h"
+#include "GameLog.h"
+
+namespace BoardState
+{
+	// Plies after which an unfinished match game is scored as a draw
+	static const int MATCH_MAX_PLIES = 400;
+	// Games between two progress lines
+	static const int MATCH_REPORT_INTERVAL = 20;
+
+	// A model and the search it plays with. A depth of 0 searches for milliseconds only, MCTS plays playouts per
+	// move and ignores both. With quantized set the engine evaluates with that int8/int16 copy of the weights instead
+	// of the float network.
+	struct MatchEngine
+	{
+		std::string name;
+		std::shared_ptr<const AnnUtilities::InferenceNetwork> weights;
+		std::shared_ptr<const QuantizedNetwork> quantized;
+		SearchMode mode = SearchMode::ALPHA_BETA;
+		int depth = 2;
+		int milliseconds = 0;
+		int playouts = 800;
+		// Only identifies the weights to the workers' accumulators, its layers are never read
+		AnnUtilities::ANNetwork identity;
+	};
+
+	// Sequential probability ratio test of H0: the first engine is elo0 stronger, against H1: it is elo1 stronger
+	struct SprtSettings
+	{
+		double elo0 = 0.0;
+		double elo1 = 10.0;
+		double alpha = 0.05;
+		double beta = 0.05;
+	};
+
+	enum class SprtDecision
+	{
+		CONTINUE,
+		ACCEPT_H0,
+		ACCEPT_H1
+	};
+
+	// Results from the first engine's point of view. pairs counts the finished colour-swapped pairs by the half points
+	// the first engine took from both games, 0 to 4.
+	struct MatchScore
+	{
+		int wins = 0;
+		int draws = 0;
+		int losses = 0;
+		int pairs[5] = { 0, 0, 0, 0, 0 };
+
+		int games								() const { return wins + draws + losses; }
+		int pairCount							() const;
+		double score							() const;
+		double elo								() const;
+		// Half the width of the 95% confidence interval of elo
+		double eloError							() const;
+		// Log likelihood ratio of H1 against H0 under the normal approximation of the pentanomial pair score. Pairs
+		// keep the colour and opening of both games together, so only finished pairs count.
+		double llr								(const SprtSettings& sprt) const;
+	};
+
+	// Plays two engines against each other on several threads. Every opening is played twice with the colours swapped,
+	// and after each completed pair the SPRT decides whether to stop. Openings come from a file of FEN or EPD lines or
+	// from a built-in set of balanced main lines. A game ends in mate, stalemate, threefold repetition, the fifty-move
+	// rule, insufficient material or after MATCH_MAX_PLIES. Every thread has a BoardManager per engine, so searches
+	// keep their own tables.
+	class Match
+	{
+	private:
+		std::vector<std::unique_ptr<BoardManager>> workers;
+		std::vector<BoardStateData> openings;
+		MatchEngine* engines[2] = { nullptr, nullptr };
+		SprtSettings sprt;
+		std::mutex mutex;
+		MatchScore score;
+		std::vector<int> pairGames;
+		// Half points of the first engine in the finished games of each pair
+		std::vector<int> pairPoints;
+		SprtDecision decision = SprtDecision::CONTINUE;
+		std::atomic<bool> stopped{ false };
+
+		GameResult playGame						(BoardManager* players[2], const BoardStateData& opening, int white);
+		void addResult							(int game, GameResult result);
+		void play								(BoardManager* players[2], std::atomic<int>& next, int games);
+
+	public:
+		void init								(int threads);
+		int threads								() const { return (int)workers.size() / 2; }
+		void setSprt							(const SprtSettings& settings) { sprt = settings; }
+		void defaultOpenings					();
+		void loadOpenings						(const std::string& fileName);
+		int openingCount						() const { return (int)openings.size(); }
+		MatchScore run							(MatchEngine& first, MatchEngine& second, int games);
+		SprtDecision result						() const { return decision; }
+	};
+}
\ No newline at end of file
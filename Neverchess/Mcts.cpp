@@ -0,0 +1,316 @@
+#include "BoardState.h"
+#include "Mcts.h"
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace BoardState
+{
+	void BoardManager::setSearchMode(SearchMode mode, int playouts)
+	{
+		searchMode = mode;
+		mctsPlayouts = playouts;
+	}
+
+	// Threads of one MCTS search, 0 uses every core. Managers that play games side by side should use 1.
+	void BoardManager::setSearchThreads(int threads)
+	{
+		availableThreads = threads;
+	}
+
+	AlphaBetaEvaluation BoardManager::mcts(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, int playouts)
+	{
+		SearchLimits limits;
+		limits.nodes = playouts;
+		return mcts(boardStateData, network, limits).evaluation;
+	}
+
+	// PUCT search driven by the value network. Worker threads select leaves with virtual loss, generate their moves
+	// in parallel and queue them; a full queue is evaluated as one batch by the thread that filled it, against weights
+	// shared by all workers and with that thread's own scratch. The subtree of the chosen move is kept for the next call.
+	// limits.nodes is the number of playouts, the setSearchMode ones when it is 0. Workers check the deadline and stop
+	// after every playout, once the root has been expanded, so a stopped search still has a move.
+	SearchResult BoardManager::mcts(BoardStateData& boardStateData, AnnUtilities::ANNetwork& network, const SearchLimits& limits)
+	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point deadline = begin + std::chrono::milliseconds(limits.milliseconds);
+		long long playouts = limits.nodes > 0 ? limits.nodes : mctsPlayouts;
+		if (mctsTree.capacity() == 0)
+		{
+			mctsTree.init(MCTS_POOL_SIZE);
+		}
+		unsigned long int rootHash = zobristHash(boardStateData);
+		int root = mctsTree.findReusableRoot(rootHash);
+		if (root == -1 || mctsTree.used > mctsTree.capacity() / 2)
+		{
+			mctsTree.clear();
+			root = mctsTree.allocate(1);
+			mctsTree.nodes[root].hash = rootHash;
+			mctsTree.nodes[root].turn = boardStateData._turn;
+		}
+		mctsTree.nodes[root].parent = -1;
+		mctsTree.root = root;
+
+		if (!accumulator.loaded(network))
+		{
+			accumulator.load(network);
+		}
+		std::shared_ptr<const AnnUtilities::InferenceNetwork> weights = accumulator.weights();
+		std::mutex treeMutex;
+		std::mutex batchMutex;
+		std::atomic<long long> started(0);
+		std::atomic<long long> evaluated(0);
+		std::atomic<bool> stopped(false);
+		std::vector<MctsLeaf> batch;
+
+		auto evaluateAndBackup = [&](std::vector<MctsLeaf>& leaves, EvaluationScratch& scratch, QuantizedScratch& quantized)
+		{
+			mctsEvaluateBatch(leaves, *weights, scratch, quantized);
+			std::lock_guard<std::mutex> lock(treeMutex);
+			for (const MctsLeaf& leaf : leaves)
+			{
+				mctsExpand(leaf);
+				mctsBackup(leaf);
+			}
+			evaluated += (long long)leaves.size();
+		};
+
+		auto worker = [&]()
+		{
+			std::vector<MctsLeaf> evaluating;
+			EvaluationScratch scratch;
+			QuantizedScratch quantized;
+			while (!stopped.load(std::memory_order_relaxed) && started.fetch_add(1) < playouts)
+			{
+				MctsLeaf leaf;
+				leaf.state.copy(boardStateData);
+				{
+					std::lock_guard<std::mutex> lock(treeMutex);
+					mctsSelect(leaf);
+				}
+				mctsGenerate(leaf);
+				{
+					std::lock_guard<std::mutex> lock(batchMutex);
+					bool flush = leaf.collision;
+					batch.push_back(std::move(leaf));
+					// A collision means the selected leaf is already waiting in a batch, so the batch has to be flushed to
+					// make progress
+					if (flush || batch.size() >= MCTS_BATCH_SIZE)
+					{
+						evaluating.swap(batch);
+					}
+				}
+				if (!evaluating.empty())
+				{
+					evaluateAndBackup(evaluating, scratch, quantized);
+					evaluating.clear();
+				}
+				if (evaluated.load(std::memory_order_relaxed) > 0
+					&& ((limits.milliseconds > 0 && std::chrono::steady_clock::now() >= deadline)
+						|| (limits.stop != nullptr && limits.stop->load(std::memory_order_relaxed))))
+				{
+					stopped = true;
+				}
+			}
+			{
+				std::lock_guard<std::mutex> lock(batchMutex);
+				evaluating.swap(batch);
+			}
+			if (!evaluating.empty())
+			{
+				evaluateAndBackup(evaluating, scratch, quantized);
+			}
+		};
+
+		int threads = availableThreads > 0 ? availableThreads : std::max(1, (int)std::thread::hardware_concurrency());
+		std::vector<std::thread> workers;
+		for (int i = 1; i < threads; ++i)
+		{
+			workers.push_back(std::thread(worker));
+		}
+		worker();
+		for (std::thread& t : workers)
+		{
+			t.join();
+		}
+
+		SearchResult result;
+		result.depth = 1;
+		result.nodes = evaluated;
+		result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		AlphaBetaEvaluation& evaluation = result.evaluation;
+		const MctsNode& rootNode = mctsTree.nodes[root];
+		if (rootNode.childCount == 0)
+		{
+			evaluate(boardStateData, network, evaluation, true);
+			return result;
+		}
+		int best = rootNode.firstChild;
+		for (int i = rootNode.firstChild; i < rootNode.firstChild + rootNode.childCount; ++i)
+		{
+			if (mctsTree.nodes[i].visits > mctsTree.nodes[best].visits)
+			{
+				best = i;
+			}
+		}
+		const MctsNode& bestNode = mctsTree.nodes[best];
+		float q = bestNode.visits > 0 ? bestNode.valueSum / bestNode.visits : MCTS_FIRST_PLAY_VALUE;
+		evaluation.move = bestNode.move;
+		evaluation.evaluatedValue = rootNode.turn ? q : 1.0f - q;
+		result.pv.assign(1, evaluation.move);
+		mctsTree.root = best;
+		return result;
+	}
+
+	int BoardManager::mctsSelectChild(int node)
+	{
+		const MctsNode& parent = mctsTree.nodes[node];
+		float parentVisits = sqrtf((float)(parent.visits + parent.virtualLoss));
+		float bestScore = -1000.0f;
+		int best = parent.firstChild;
+		for (int i = parent.firstChild; i < parent.firstChild + parent.childCount; ++i)
+		{
+			const MctsNode& child = mctsTree.nodes[i];
+			int childVisits = child.visits + child.virtualLoss;
+			// Virtual losses count as visits with no value, steering other threads away from paths that are being evaluated
+			float q = childVisits > 0 ? child.valueSum / childVisits : MCTS_FIRST_PLAY_VALUE;
+			float score = q + MCTS_CPUCT * child.prior * parentVisits / (1 + childVisits);
+			if (score > bestScore)
+			{
+				bestScore = score;
+				best = i;
+			}
+		}
+		return best;
+	}
+
+	void BoardManager::mctsSelect(MctsLeaf& leaf)
+	{
+		int node = mctsTree.root;
+		leaf.path.push_back(node);
+		++mctsTree.nodes[node].virtualLoss;
+		while (mctsTree.nodes[node].expanded && !mctsTree.nodes[node].terminal)
+		{
+			node = mctsSelectChild(node);
+			playMove(leaf.state, mctsTree.nodes[node].move);
+			leaf.path.push_back(node);
+			++mctsTree.nodes[node].virtualLoss;
+		}
+		leaf.node = node;
+		if (mctsTree.nodes[node].terminal)
+		{
+			leaf.terminal = true;
+			leaf.value = mctsTree.nodes[node].terminalValue;
+		}
+		else if (mctsTree.nodes[node].pending)
+		{
+			leaf.collision = true;
+		}
+		else
+		{
+			mctsTree.nodes[node].pending = true;
+		}
+	}
+
+	void BoardManager::mctsGenerate(MctsLeaf& leaf)
+	{
+		if (leaf.collision || leaf.terminal)
+		{
+			return;
+		}
+		leaf.moves = genRawMoves(leaf.state);
+		std::vector<BoardStateData> newStates = filterMoves(leaf.state, leaf.moves);
+		leaf.childHashes.resize(newStates.size());
+		for (unsigned int i = 0; i < newStates.size(); ++i)
+		{
+			leaf.childHashes[i] = zobristHash(newStates[i]);
+		}
+		leaf.mated = newStates.empty() && inCheck(leaf.state);
+	}
+
+	// Only reads the manager, so workers can evaluate their batches at the same time. The float network evaluates all
+	// leaves that need it in one forward pass, the quantized network has no batched kernels and goes leaf by leaf.
+	void BoardManager::mctsEvaluateBatch(std::vector<MctsLeaf>& batch, const AnnUtilities::InferenceNetwork& weights, EvaluationScratch& scratch, QuantizedScratch& quantized) const
+	{
+		std::vector<MctsLeaf*> evaluated;
+		std::vector<const BoardStateData*> positions;
+		for (MctsLeaf& leaf : batch)
+		{
+			if (leaf.collision || leaf.terminal)
+			{
+				continue;
+			}
+			if (leaf.moves.size() == 0)
+			{
+				leaf.value = !leaf.mated ? (LOW_LABEL + HIGH_LABEL) * 0.5f : leaf.state._turn ? LOW_LABEL : HIGH_LABEL;
+			}
+			else if (quantizedNetwork != nullptr)
+			{
+				leaf.value = quantizedNetwork->evaluate(leaf.state, quantized);
+			}
+			else
+			{
+				evaluated.push_back(&leaf);
+				positions.push_back(&leaf.state);
+			}
+		}
+		std::vector<float> values(positions.size());
+		evaluateBatch(weights, positions, values.data(), scratch);
+		for (unsigned int i = 0; i < evaluated.size(); ++i)
+		{
+			evaluated[i]->value = values[i];
+		}
+	}
+
+	void BoardManager::mctsExpand(const MctsLeaf& leaf)
+	{
+		MctsNode& node = mctsTree.nodes[leaf.node];
+		if (leaf.collision || leaf.terminal)
+		{
+			return;
+		}
+		node.pending = false;
+		if (leaf.moves.size() == 0)
+		{
+			node.terminal = true;
+			node.terminalValue = leaf.value;
+			return;
+		}
+		// A full pool leaves the node unexpanded, it is then evaluated again on every visit
+		int first = mctsTree.allocate((int)leaf.moves.size());
+		if (first == -1)
+		{
+			return;
+		}
+		node.firstChild = first;
+		node.childCount = (int)leaf.moves.size();
+		node.expanded = true;
+		for (int i = 0; i < node.childCount; ++i)
+		{
+			MctsNode& child = mctsTree.nodes[first + i];
+			child.move = leaf.moves[i];
+			child.hash = leaf.childHashes[i];
+			child.parent = leaf.node;
+			child.turn = !node.turn;
+			child.prior = 1.0f / node.childCount;
+		}
+	}
+
+	void BoardManager::mctsBackup(const MctsLeaf& leaf)
+	{
+		for (int node : leaf.path)
+		{
+			MctsNode& n = mctsTree.nodes[node];
+			--n.virtualLoss;
+			if (!leaf.collision)
+			{
+				++n.visits;
+				// The network estimates black's chance to win, nodes store the value for the player who moved into them
+				n.valueSum += n.turn ? 1.0f - leaf.value : leaf.value;
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include "PieceCode.h"
+#include "MoveData.h"
+
+namespace BoardState
+{
+	static const int MCTS_POOL_SIZE = 1 << 18;
+	static const int MCTS_BATCH_SIZE = 8;
+	static const float MCTS_CPUCT = 1.5f;
+	static const float MCTS_FIRST_PLAY_VALUE = 0.5f;
+
+	struct MctsNode
+	{
+		MoveData move;
+		unsigned long int hash = 0;
+		int parent = -1;
+		int firstChild = -1;
+		int childCount = 0;
+		int visits = 0;
+		int virtualLoss = 0;
+		// Sum of backed up values from the point of view of the player who made the move leading to this node
+		float valueSum = 0.0f;
+		float prior = 0.0f;
+		float terminalValue = 0.0f;
+		bool turn = 0;
+		bool expanded = false;
+		bool pending = false;
+		bool terminal = false;
+	};
+
+	// Node pool for the search tree. Children of a node are allocated as one contiguous block and nodes are never
+	// freed one by one: the pool is cleared when the previous tree can not be reused or has used up half of the pool.
+	class MctsTree
+	{
+	public:
+		std::vector<MctsNode> nodes;
+		int used = 0;
+		int root = -1;
+
+		void init(int capacity)
+		{
+			nodes.resize(capacity);
+			clear();
+		}
+
+		void clear()
+		{
+			used = 0;
+			root = -1;
+		}
+
+		int capacity() const
+		{
+			return (int)nodes.size();
+		}
+
+		// Returns the index of the first node in a block of count fresh nodes or -1 if the pool is full
+		int allocate(int count)
+		{
+			if (used + count > capacity())
+			{
+				return -1;
+			}
+			int first = used;
+			for (int i = first; i < first + count; ++i)
+			{
+				nodes[i] = MctsNode();
+			}
+			used += count;
+			return first;
+		}
+
+		// Looks for the position among the current root, its children and grandchildren so the subtree
+		// searched on previous moves can be kept. Returns -1 if the position is not in the tree.
+		int findReusableRoot(unsigned long int hash) const
+		{
+			if (root == -1)
+			{
+				return -1;
+			}
+			if (nodes[root].hash == hash)
+			{
+				return root;
+			}
+			for (int i = nodes[root].firstChild; i < nodes[root].firstChild + nodes[root].childCount; ++i)
+			{
+				if (nodes[i].hash == hash)
+				{
+					return i;
+				}
+				for (int j = nodes[i].firstChild; j < nodes[i].firstChild + nodes[i].childCount; ++j)
+				{
+					if (nodes[j].hash == hash)
+					{
+						return j;
+					}
+				}
+			}
+			return -1;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "ModelFile.h"
+#include "NetworkArena.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace AnnUtilities
+{
+	uint64_t modelChecksum(const void* data, size_t bytes)
+	{
+		const uint64_t* words = (const uint64_t*)data;
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < bytes / sizeof(uint64_t); ++i)
+		{
+			hash = (hash ^ words[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	ModelHeader makeModelHeader(const ANNSettings& settings, size_t dataBytes, uint64_t checksum)
+	{
+		ModelHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+		header.version = MODEL_VERSION;
+		header.headerBytes = sizeof(ModelHeader);
+		header.dtype = (uint32_t)ModelDtype::FLOAT32;
+		header.alignment = ARENA_ALIGNMENT;
+		header.inputSize = settings._inputSize;
+		header.hiddenSize = settings._hiddenSize;
+		header.outputSize = settings._outputSize;
+		header.hiddenLayers = settings._numberOfHiddenLayers;
+		header.hiddenActivation = (int32_t)settings._hiddenActicationFunction;
+		header.outputActivation = (int32_t)settings._outputActicationFunction;
+		header.dataOffset = MODEL_PAGE_SIZE;
+		header.dataBytes = dataBytes;
+		header.checksum = checksum;
+		return header;
+	}
+
+	void checkModelHeader(const ModelHeader& header, size_t fileBytes, const std::string& fileName)
+	{
+		if (fileBytes < sizeof(ModelHeader) || memcmp(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0)
+		{
+			throw std::runtime_error(fileName + ": not a model file");
+		}
+		if (header.version != MODEL_VERSION || header.headerBytes != sizeof(ModelHeader))
+		{
+			throw std::runtime_error(fileName + ": unsupported model version " + std::to_string(header.version));
+		}
+		if (header.dtype != (uint32_t)ModelDtype::FLOAT32 || header.alignment != ARENA_ALIGNMENT)
+		{
+			throw std::runtime_error(fileName + ": unsupported weight type or alignment");
+		}
+		if (header.inputSize <= 0 || header.hiddenSize <= 0 || header.outputSize <= 0 || header.hiddenLayers < 0)
+		{
+			throw std::runtime_error(fileName + ": invalid topology");
+		}
+		if (header.dataOffset % MODEL_PAGE_SIZE != 0 || header.dataOffset + header.dataBytes > fileBytes)
+		{
+			throw std::runtime_error(fileName + ": truncated model file");
+		}
+	}
+
+	ANNSettings modelSettings(const ModelHeader& header)
+	{
+		ANNSettings settings;
+		settings._inputSize = header.inputSize;
+		settings._hiddenSize = header.hiddenSize;
+		settings._outputSize = header.outputSize;
+		settings._numberOfHiddenLayers = header.hiddenLayers;
+		settings._hiddenActicationFunction = (ACTFUNC)header.hiddenActivation;
+		settings._outputActicationFunction = (ACTFUNC)header.outputActivation;
+		return settings;
+	}
+
+	void sealModelImage(std::vector<char>& image)
+	{
+		ModelHeader header;
+		memcpy(&header, &image[0], sizeof(header));
+		header.checksum = modelChecksum(&image[header.dataOffset], header.dataBytes);
+		memcpy(&image[0], &header, sizeof(header));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <ANNSettings.h>
+
+namespace AnnUtilities
+{
+	static const char MODEL_MAGIC[8] = { 'N', 'C', 'M', 'O', 'D', 'E', 'L', 0 };
+	static const uint32_t MODEL_VERSION = 1;
+	// The parameter block starts on the first page boundary after the header, so a mapped file is used in place
+	static const size_t MODEL_PAGE_SIZE = 4096;
+
+	enum class ModelDtype : uint32_t
+	{
+		FLOAT32 = 0
+	};
+
+	// Header at the start of a binary model file, written in the byte order of the machine that trained the model.
+	// The parameter block that follows is the PARAMETERS arena image of the topology: every layer's weights then
+	// biases, padded to cache lines, with the first layer input-major.
+	struct ModelHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t headerBytes;
+		uint32_t dtype;
+		uint32_t alignment;
+		int32_t inputSize;
+		int32_t hiddenSize;
+		int32_t outputSize;
+		int32_t hiddenLayers;
+		int32_t hiddenActivation;
+		int32_t outputActivation;
+		uint64_t dataOffset;
+		uint64_t dataBytes;
+		uint64_t checksum;
+	};
+
+	// FNV-1a over 64 bit words, bytes has to be a multiple of 8
+	uint64_t modelChecksum						(const void* data, size_t bytes);
+	ModelHeader makeModelHeader					(const ANNSettings& settings, size_t dataBytes, uint64_t checksum);
+	// Throws std::runtime_error when the header does not describe a model this build can read from a file of fileBytes
+	void checkModelHeader						(const ModelHeader& header, size_t fileBytes, const std::string& fileName);
+	ANNSettings modelSettings					(const ModelHeader& header);
+	// Fills in the checksum of a model image that was built with a checksum of 0
+	void sealModelImage							(std::vector<char>& image);
+}
\ No newline at end of file
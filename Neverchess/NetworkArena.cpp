@@ -0,0 +1,380 @@
+#include "NetworkArena.h"
+#include "ModelFile.h"
+#include <Layer.h>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <new>
+#include <fstream>
+#include <algorithm>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace AnnUtilities
+{
+	int arenaPadded(int n)
+	{
+		return (n + ARENA_LINE_FLOATS - 1) / ARENA_LINE_FLOATS * ARENA_LINE_FLOATS;
+	}
+
+	NetworkArena::~NetworkArena()
+	{
+		release();
+	}
+
+	void NetworkArena::release()
+	{
+		switch (allocation)
+		{
+		case Allocation::NONE:
+			break;
+		case Allocation::ALIGNED:
+		case Allocation::TRANSPARENT_HUGE_PAGES:
+#ifdef _WIN32
+			_aligned_free(base);
+#else
+			free(base);
+#endif
+			break;
+		case Allocation::HUGE_PAGES:
+#ifdef _WIN32
+			VirtualFree(base, 0, MEM_RELEASE);
+#else
+			munmap(base, allocatedBytes);
+#endif
+			break;
+		case Allocation::FILE_MAPPING:
+#ifdef _WIN32
+			UnmapViewOfFile(mapping);
+#else
+			munmap(mapping, allocatedBytes);
+#endif
+			break;
+		}
+		base = nullptr;
+		mapping = nullptr;
+		floats = 0;
+		allocatedBytes = 0;
+		allocation = Allocation::NONE;
+	}
+
+	// Offsets of every region for the current settings, contents and batch
+	void NetworkArena::layout()
+	{
+		layers.assign(settings._numberOfHiddenLayers + 1, ArenaLayer());
+		int cols = settings._inputSize;
+		for (int i = 0; i < (int)layers.size(); ++i)
+		{
+			ArenaLayer& l = layers[i];
+			bool output = i == (int)layers.size() - 1;
+			l.rows = output ? settings._outputSize : settings._hiddenSize;
+			l.cols = cols;
+			l.paddedRows = arenaPadded(l.rows);
+			l.paddedCols = i == 0 ? cols : arenaPadded(cols);
+			l.actfunc = output ? settings._outputActicationFunction : settings._hiddenActicationFunction;
+			cols = l.rows;
+		}
+
+		// Every region is a whole number of cache lines, so every offset stays aligned
+		size_t offset = 0;
+		if (contents != ArenaContents::GRADIENTS)
+		{
+			for (ArenaLayer& l : layers)
+			{
+				l.weights = offset;
+				offset += (size_t)l.paddedCols * l.paddedRows;
+				l.biases = offset;
+				offset += l.paddedRows;
+			}
+		}
+		parameterFloats = offset;
+		if (contents != ArenaContents::PARAMETERS)
+		{
+			for (ArenaLayer& l : layers)
+			{
+				l.outputs = offset;
+				offset += (size_t)batch * l.paddedRows;
+				l.errors = offset;
+				offset += (size_t)batch * l.paddedRows;
+			}
+			for (ArenaLayer& l : layers)
+			{
+				l.weightGradients = offset;
+				offset += (size_t)l.paddedCols * l.paddedRows;
+				l.biasGradients = offset;
+				offset += l.paddedRows;
+			}
+			if (contents == ArenaContents::TRAINING && settings._momentum > 0.0f)
+			{
+				for (ArenaLayer& l : layers)
+				{
+					l.weightMomentum = offset;
+					offset += (size_t)l.paddedCols * l.paddedRows;
+					l.biasMomentum = offset;
+					offset += l.paddedRows;
+				}
+			}
+		}
+		floats = offset;
+	}
+
+	// Lays out the network described by the settings. Explicit huge pages need to be reserved by the system, without
+	// them Linux falls back to transparent huge pages and any other system to ordinary aligned memory.
+	void NetworkArena::allocate(const ANNSettings& networkSettings, ArenaContents arenaContents, int batchSize, bool hugePages)
+	{
+		if (base != nullptr && allocation != Allocation::FILE_MAPPING && contents == arenaContents && batch == batchSize && hugePagesRequested == hugePages
+			&& settings._inputSize == networkSettings._inputSize && settings._hiddenSize == networkSettings._hiddenSize
+			&& settings._outputSize == networkSettings._outputSize && settings._numberOfHiddenLayers == networkSettings._numberOfHiddenLayers
+			&& (settings._momentum > 0.0f) == (networkSettings._momentum > 0.0f))
+		{
+			settings = networkSettings;
+			return;
+		}
+		release();
+		settings = networkSettings;
+		contents = arenaContents;
+		batch = contents != ArenaContents::PARAMETERS ? batchSize : 0;
+		hugePagesRequested = hugePages;
+
+		layout();
+
+		size_t bytes = floats * sizeof(float);
+		if (hugePages)
+		{
+			size_t rounded = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+#ifdef _WIN32
+			SIZE_T largePage = GetLargePageMinimum();
+			if (largePage != 0)
+			{
+				rounded = (bytes + largePage - 1) / largePage * largePage;
+				base = (float*)VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+				if (base != nullptr)
+				{
+					allocation = Allocation::HUGE_PAGES;
+					allocatedBytes = rounded;
+				}
+			}
+#else
+			void* p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (p != MAP_FAILED)
+			{
+				base = (float*)p;
+				allocation = Allocation::HUGE_PAGES;
+				allocatedBytes = rounded;
+			}
+			else if (posix_memalign(&p, HUGE_PAGE_SIZE, rounded) == 0)
+			{
+				madvise(p, rounded, MADV_HUGEPAGE);
+				base = (float*)p;
+				allocation = Allocation::TRANSPARENT_HUGE_PAGES;
+				allocatedBytes = rounded;
+			}
+#endif
+		}
+		if (base == nullptr)
+		{
+#ifdef _WIN32
+			base = (float*)_aligned_malloc(bytes, ARENA_ALIGNMENT);
+#else
+			void* p = nullptr;
+			base = posix_memalign(&p, ARENA_ALIGNMENT, bytes) == 0 ? (float*)p : nullptr;
+#endif
+			allocation = Allocation::ALIGNED;
+			allocatedBytes = bytes;
+		}
+		if (base == nullptr)
+		{
+			allocation = Allocation::NONE;
+			throw std::bad_alloc();
+		}
+		memset(base, 0, bytes);
+	}
+
+	// Copies the parameters of a network built with the same settings into the arena
+	void NetworkArena::load(const ANNetwork& network)
+	{
+		if (contents == ArenaContents::GRADIENTS || allocation == Allocation::FILE_MAPPING)
+		{
+			throw std::logic_error("NetworkArena::load: arena holds no writable parameters");
+		}
+		memset(base, 0, parameterFloats * sizeof(float));
+		const Layer* source = network._inputLayer->_nextLayer;
+		for (int i = 0; i < (int)layers.size(); ++i, source = source->_nextLayer)
+		{
+			const ArenaLayer& l = layers[i];
+			float* weights = at(l.weights);
+			for (int r = 0; r < l.rows; ++r)
+			{
+				for (int c = 0; c < l.cols; ++c)
+				{
+					float w = source->_weights[r * l.cols + c];
+					if (i == 0)
+					{
+						weights[c * l.paddedRows + r] = w;
+					}
+					else
+					{
+						weights[r * l.paddedCols + c] = w;
+					}
+				}
+			}
+			memcpy(at(l.biases), source->_biases, l.rows * sizeof(float));
+		}
+	}
+
+	// Copies the parameters back into a network built with the same settings
+	void NetworkArena::store(ANNetwork& network) const
+	{
+		if (contents == ArenaContents::GRADIENTS)
+		{
+			throw std::logic_error("NetworkArena::store: arena holds no parameters");
+		}
+		Layer* target = network._inputLayer->_nextLayer;
+		for (int i = 0; i < (int)layers.size(); ++i, target = target->_nextLayer)
+		{
+			const ArenaLayer& l = layers[i];
+			const float* weights = at(l.weights);
+			for (int r = 0; r < l.rows; ++r)
+			{
+				for (int c = 0; c < l.cols; ++c)
+				{
+					target->_weights[r * l.cols + c] = i == 0 ? weights[c * l.paddedRows + r] : weights[r * l.paddedCols + c];
+				}
+			}
+			memcpy(target->_biases, at(l.biases), l.rows * sizeof(float));
+		}
+	}
+
+	// Snapshot of the parameters of an arena with the same layout, activations and gradients are left alone
+	void NetworkArena::copyParameters(const NetworkArena& other)
+	{
+		if (other.parameterFloats != parameterFloats)
+		{
+			throw std::invalid_argument("NetworkArena::copyParameters: layouts differ");
+		}
+		memcpy(base, other.base, parameterFloats * sizeof(float));
+	}
+
+	// Appends the header page and a copy of the parameter block, with a checksum of 0 so that the copy is all the
+	// caller pays for. sealModelImage fills the checksum in.
+	void NetworkArena::modelImage(std::vector<char>& image) const
+	{
+		if (contents == ArenaContents::GRADIENTS)
+		{
+			throw std::logic_error("NetworkArena::modelImage: arena holds no parameters");
+		}
+		size_t dataBytes = parameterFloats * sizeof(float);
+		ModelHeader header = makeModelHeader(settings, dataBytes, 0);
+		size_t start = image.size();
+		image.resize(start + MODEL_PAGE_SIZE + dataBytes, 0);
+		memcpy(&image[start], &header, sizeof(header));
+		memcpy(&image[start + MODEL_PAGE_SIZE], base, dataBytes);
+	}
+
+	// Writes the header and the parameter block. Text export stays in BoardManager::exportANN for debugging.
+	void NetworkArena::writeModel(const std::string& fileName, SyncPolicy policy) const
+	{
+		std::vector<char> image;
+		modelImage(image);
+		sealModelImage(image);
+		writeFileAtomically(fileName, image.data(), image.size(), policy);
+	}
+
+	// Maps a model file read-only and uses its parameter block in place, after checking the header and checksum
+	void NetworkArena::mapModel(const std::string& fileName)
+	{
+		release();
+		size_t fileBytes = 0;
+#ifdef _WIN32
+		HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error(fileName + ": could not open model");
+		}
+		LARGE_INTEGER size;
+		GetFileSizeEx(file, &size);
+		fileBytes = (size_t)size.QuadPart;
+		HANDLE view = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		mapping = view != nullptr ? MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (view != nullptr)
+		{
+			CloseHandle(view);
+		}
+		CloseHandle(file);
+		if (mapping == nullptr)
+		{
+			throw std::runtime_error(fileName + ": could not map model");
+		}
+#else
+		int file = open(fileName.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			throw std::runtime_error(fileName + ": could not open model");
+		}
+		struct stat status;
+		fstat(file, &status);
+		fileBytes = (size_t)status.st_size;
+		void* p = fileBytes > 0 ? mmap(nullptr, fileBytes, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+		close(file);
+		if (p == MAP_FAILED)
+		{
+			throw std::runtime_error(fileName + ": could not map model");
+		}
+		mapping = p;
+#endif
+		allocation = Allocation::FILE_MAPPING;
+		allocatedBytes = fileBytes;
+
+		ModelHeader header;
+		memcpy(&header, mapping, std::min(fileBytes, sizeof(header)));
+		checkModelHeader(header, fileBytes, fileName);
+		settings = modelSettings(header);
+		contents = ArenaContents::PARAMETERS;
+		batch = 0;
+		hugePagesRequested = false;
+		layout();
+		base = (float*)((char*)mapping + header.dataOffset);
+		if (header.dataBytes != parameterFloats * sizeof(float) || modelChecksum(base, (size_t)header.dataBytes) != header.checksum)
+		{
+			release();
+			throw std::runtime_error(fileName + ": model data does not match its header");
+		}
+	}
+
+	// Parameters and momentum are all a training arena carries from one batch to the next, the other regions are
+	// rebuilt by every batch. readState expects an arena allocated with the settings of the one that was written.
+	void NetworkArena::writeState(std::ostream& out) const
+	{
+		out.write((const char*)base, parameterFloats * sizeof(float));
+		if (contents == ArenaContents::TRAINING && settings._momentum > 0.0f)
+		{
+			size_t momentum = layers[0].weightMomentum;
+			out.write((const char*)(base + momentum), (floats - momentum) * sizeof(float));
+		}
+	}
+
+	void NetworkArena::readState(std::istream& in)
+	{
+		if (contents == ArenaContents::GRADIENTS || allocation == Allocation::FILE_MAPPING)
+		{
+			throw std::logic_error("NetworkArena::readState: arena holds no writable parameters");
+		}
+		in.read((char*)base, parameterFloats * sizeof(float));
+		if (contents == ArenaContents::TRAINING && settings._momentum > 0.0f)
+		{
+			size_t momentum = layers[0].weightMomentum;
+			in.read((char*)(base + momentum), (floats - momentum) * sizeof(float));
+		}
+		if (!in)
+		{
+			throw std::runtime_error("NetworkArena::readState: state is truncated");
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <string>
+#include <iosfwd>
+#include <ANNetwork.h>
+#include <ANNSettings.h>
+#include "SnapshotWriter.h"
+
+namespace AnnUtilities
+{
+	static const int ARENA_ALIGNMENT = 64;
+	static const int ARENA_LINE_FLOATS = ARENA_ALIGNMENT / sizeof(float);
+	static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	// PARAMETERS holds weights and biases, GRADIENTS activations, errors and gradients, TRAINING all of them and momentum
+	enum class ArenaContents
+	{
+		PARAMETERS,
+		GRADIENTS,
+		TRAINING
+	};
+
+	// Rounds a layer size up to whole cache lines of floats
+	int arenaPadded(int n);
+
+	// Offsets are counted in floats from the start of the arena, so the layout stays valid for copies and mapped files.
+	// Layer 0 is the first hidden layer, its weights are stored input-major: weights + input * paddedRows is the
+	// contiguous column of one input, which is what sparse inputs add up. Later layers are row-major with every row
+	// padded to paddedCols so that each row starts on a cache line and the kernels never run a scalar tail.
+	struct ArenaLayer
+	{
+		int rows = 0;
+		int cols = 0;
+		int paddedRows = 0;
+		int paddedCols = 0;
+		ACTFUNC actfunc = ACTFUNC::TANH;
+		size_t weights = 0;
+		size_t biases = 0;
+		size_t outputs = 0;
+		size_t errors = 0;
+		size_t weightGradients = 0;
+		size_t biasGradients = 0;
+		size_t weightMomentum = 0;
+		size_t biasMomentum = 0;
+	};
+
+	// Weights, biases, activations, gradients and momentum of a whole network in one 64 byte aligned block. The
+	// parameters of every layer come first, so a snapshot for another thread copies a single prefix of the block.
+	// Activations and errors have room for batch samples. Padding is zero in the parameters and has to stay zero.
+	// Offsets of regions an arena does not hold are 0 and must not be used. A mapped model file is a PARAMETERS arena
+	// that uses the file's pages in place and is read-only.
+	class NetworkArena
+	{
+	private:
+		enum class Allocation
+		{
+			NONE,
+			ALIGNED,
+			HUGE_PAGES,
+			TRANSPARENT_HUGE_PAGES,
+			FILE_MAPPING
+		};
+
+		float* base = nullptr;
+		size_t floats = 0;
+		size_t parameterFloats = 0;
+		size_t allocatedBytes = 0;
+		void* mapping = nullptr;
+		Allocation allocation = Allocation::NONE;
+		ANNSettings settings;
+		int batch = 0;
+		bool hugePagesRequested = false;
+		ArenaContents contents = ArenaContents::TRAINING;
+		std::vector<ArenaLayer> layers;
+
+		void release							();
+		void layout								();
+
+	public:
+		NetworkArena							() = default;
+		NetworkArena							(const NetworkArena&) = delete;
+		NetworkArena& operator=					(const NetworkArena&) = delete;
+		~NetworkArena							();
+
+		void allocate							(const ANNSettings& networkSettings, ArenaContents arenaContents, int batchSize, bool hugePages);
+		void load								(const ANNetwork& network);
+		void store								(ANNetwork& network) const;
+		void copyParameters						(const NetworkArena& other);
+		void modelImage							(std::vector<char>& image) const;
+		void writeModel							(const std::string& fileName, SyncPolicy policy) const;
+		void mapModel							(const std::string& fileName);
+		void writeState							(std::ostream& out) const;
+		void readState							(std::istream& in);
+
+		float* at								(size_t offset) { return base + offset; }
+		const float* at							(size_t offset) const { return base + offset; }
+		const ArenaLayer& layer					(int i) const { return layers[i]; }
+		const ArenaLayer& outputLayer			() const { return layers.back(); }
+		int layerCount							() const { return (int)layers.size(); }
+		int inputSize							() const { return settings._inputSize; }
+		const ANNSettings& networkSettings		() const { return settings; }
+		int batchSize							() const { return batch; }
+		size_t parameterCount					() const { return parameterFloats; }
+		size_t bytes							() const { return floats * sizeof(float); }
+		bool onHugePages						() const { return allocation == Allocation::HUGE_PAGES; }
+		bool empty								() const { return base == nullptr; }
+	};
+}
\ No newline at end of file
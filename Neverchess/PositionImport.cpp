@@ -0,0 +1,508 @@
+#include "PositionImport.h"
+#include "Fen.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <thread>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <stdexcept>
+
+namespace BoardState
+{
+	ImportFormat importFormat(const std::string& fileName)
+	{
+		std::string extension = fileName.substr(std::min(fileName.size(), fileName.rfind('.')));
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower(c); });
+		return extension == ".epd" ? ImportFormat::EPD : extension == ".games" ? ImportFormat::GAME_LOG : ImportFormat::PGN;
+	}
+
+	static PieceCode sanPiece(char c, bool turn)
+	{
+		PieceCode piece;
+		switch (c)
+		{
+		case 'K': piece = PieceCode::W_KING; break;
+		case 'Q': piece = PieceCode::W_QUEEN; break;
+		case 'R': piece = PieceCode::W_ROOK; break;
+		case 'B': piece = PieceCode::W_BISHOP; break;
+		case 'N': piece = PieceCode::W_KNIGHT; break;
+		default: return PieceCode::EMPTY;
+		}
+		return turn ? (PieceCode)((int)piece | (1 << (PIECE_CODE_LENGTH - 1))) : piece;
+	}
+
+	// Matches the text against the generated moves first and checks only the candidates for legality, a pin may be
+	// what tells two of them apart
+	bool BoardManager::parseSan(const BoardStateData& boardStateData, const std::string& san, MoveData& move)
+	{
+		std::vector<MoveData> candidates;
+		std::vector<MoveData> moves = genRawMoves(boardStateData);
+		std::string text = san;
+		while (!text.empty() && (text.back() == '+' || text.back() == '#' || text.back() == '!' || text.back() == '?'))
+		{
+			text.pop_back();
+		}
+		if (text == "O-O" || text == "0-0" || text == "O-O-O" || text == "0-0-0")
+		{
+			bool longCastle = text.size() == 5;
+			for (const MoveData& generated : moves)
+			{
+				if (longCastle ? generated.longCastle : generated.shortCastle)
+				{
+					candidates.push_back(generated);
+				}
+			}
+			filterMoves(boardStateData, candidates);
+			if (candidates.size() == 1)
+			{
+				move = candidates[0];
+			}
+			return candidates.size() == 1;
+		}
+
+		bool turn = boardStateData._turn;
+		PieceCode upgrade = PieceCode::EMPTY;
+		size_t equals = text.find('=');
+		if (equals != std::string::npos)
+		{
+			upgrade = equals + 1 < text.size() ? sanPiece(text[equals + 1], turn) : PieceCode::EMPTY;
+			if (upgrade == PieceCode::EMPTY)
+			{
+				return false;
+			}
+			text.resize(equals);
+		}
+		else if (text.size() > 2 && isdigit((unsigned char)text[text.size() - 2]) && sanPiece(text.back(), turn) != PieceCode::EMPTY)
+		{
+			// e8Q without the equals sign
+			upgrade = sanPiece(text.back(), turn);
+			text.pop_back();
+		}
+
+		PieceCode piece = turn ? PieceCode::B_PAWN : PieceCode::W_PAWN;
+		size_t at = 0;
+		if (!text.empty() && sanPiece(text[0], turn) != PieceCode::EMPTY)
+		{
+			piece = sanPiece(text[0], turn);
+			at = 1;
+		}
+		if (text.size() < at + 2)
+		{
+			return false;
+		}
+		int xEnd = text[text.size() - 2] - 'a';
+		int yEnd = text[text.size() - 1] - '1';
+		if (xEnd < 0 || xEnd >= BOARD_LENGTH || yEnd < 0 || yEnd >= BOARD_LENGTH)
+		{
+			return false;
+		}
+		int xStart = -1;
+		int yStart = -1;
+		for (size_t i = at; i < text.size() - 2; ++i)
+		{
+			if (text[i] >= 'a' && text[i] <= 'h')
+			{
+				xStart = text[i] - 'a';
+			}
+			else if (text[i] >= '1' && text[i] <= '8')
+			{
+				yStart = text[i] - '1';
+			}
+			else if (text[i] != 'x' && text[i] != ':' && text[i] != '-')
+			{
+				return false;
+			}
+		}
+
+		// Only queen and knight promotions are generated, a rook or bishop promotion reuses the queen's move
+		PieceCode generatedUpgrade = upgrade == PieceCode::EMPTY || upgrade == PieceCode::W_KNIGHT || upgrade == PieceCode::B_KNIGHT
+			? upgrade : turn ? PieceCode::B_QUEEN : PieceCode::W_QUEEN;
+		for (const MoveData& generated : moves)
+		{
+			if (!generated.shortCastle && !generated.longCastle && generated.xEnd == xEnd && generated.yEnd == yEnd
+				&& generated.upgrade == generatedUpgrade && boardStateData._pieces[generated.yStart * BOARD_LENGTH + generated.xStart] == piece
+				&& (xStart < 0 || generated.xStart == xStart) && (yStart < 0 || generated.yStart == yStart))
+			{
+				candidates.push_back(generated);
+			}
+		}
+		filterMoves(boardStateData, candidates);
+		if (candidates.size() != 1)
+		{
+			return false;
+		}
+		move = candidates[0];
+		move.upgrade = upgrade;
+		return true;
+	}
+
+	static bool knownResult(const std::string& result)
+	{
+		return result == "1-0" || result == "0-1" || result == "1/2-1/2";
+	}
+
+	// White's score from a game result or a number between 0 and 1
+	static bool whiteScore(const std::string& text, float& score)
+	{
+		if (knownResult(text))
+		{
+			score = text == "1-0" ? 1.0f : text == "0-1" ? 0.0f : 0.5f;
+			return true;
+		}
+		char* end = nullptr;
+		score = strtof(text.c_str(), &end);
+		return !text.empty() && *end == 0 && score >= 0.0f && score <= 1.0f;
+	}
+
+	void PositionImporter::init(int threads)
+	{
+		workers.resize(std::max(1, threads));
+		for (std::unique_ptr<BoardManager>& worker : workers)
+		{
+			if (!worker)
+			{
+				worker.reset(new BoardManager());
+			}
+		}
+	}
+
+	void PositionImporter::count(long long positions, bool skipped)
+	{
+		stats.positions += positions;
+		stats.skipped += skipped;
+		if (stats.positions - reported >= IMPORT_REPORT_INTERVAL)
+		{
+			reported = stats.positions;
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			std::cout << "Imported " << stats.positions << " positions, " << (long long)(stats.positions / seconds) << " positions/s" << std::endl;
+		}
+	}
+
+	void PositionImporter::finishGame(PlayedGame& game, bool valid, const std::string& result)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!valid || !knownResult(result) || game.moves.empty())
+		{
+			count(0, true);
+			return;
+		}
+		game.index = (int)stats.games++;
+		game.whiteWin = result == "1-0";
+		game.blackWin = result == "0-1";
+		if (gameSink)
+		{
+			gameSink(game);
+		}
+		count((long long)game.moves.size(), false);
+	}
+
+	void PositionImporter::importEpdLine(const std::string& line)
+	{
+		std::istringstream fields(line);
+		std::string field[4];
+		BoardStateData boardStateData;
+		if (!(fields >> field[0] >> field[1] >> field[2] >> field[3]))
+		{
+			// Blank lines are not positions and not worth counting
+			return;
+		}
+		std::string operations;
+		std::getline(fields, operations);
+
+		std::string value;
+		size_t at = operations.find("c9 ");
+		if (at != std::string::npos)
+		{
+			size_t valueBegin = operations.find_first_not_of(" \"", at + 3);
+			value = valueBegin == std::string::npos ? "" : operations.substr(valueBegin, operations.find_first_of("\";", valueBegin) - valueBegin);
+		}
+		else if ((at = operations.find('[')) != std::string::npos)
+		{
+			value = operations.substr(at + 1, operations.find(']', at) - at - 1);
+		}
+		else
+		{
+			// A bare game result as the last word, move counters are not taken for one
+			std::istringstream words(operations);
+			std::string word;
+			while (words >> word)
+			{
+				value = word;
+			}
+			value = value.substr(0, value.find(';'));
+			value = knownResult(value) ? value : "";
+		}
+
+		float score;
+		bool valid = whiteScore(value, score) && parseFen(field[0] + " " + field[1] + " " + field[2] + " " + field[3], boardStateData);
+		std::lock_guard<std::mutex> lock(mutex);
+		if (valid && positionSink)
+		{
+			// Labels are the probability that black wins
+			positionSink(boardStateData, HIGH_LABEL + score * (LOW_LABEL - HIGH_LABEL));
+		}
+		count(valid, !valid);
+	}
+
+	void PositionImporter::importRange(BoardManager& worker, const std::string& fileName, ImportFormat format, uint64_t rangeBegin, uint64_t rangeEnd)
+	{
+		std::vector<char> readBuffer(IMPORT_READ_BUFFER);
+		std::ifstream in;
+		in.rdbuf()->pubsetbuf(readBuffer.data(), readBuffer.size());
+		in.open(fileName, std::ios_base::binary);
+		std::string line;
+		uint64_t offset = 0;
+		if (rangeBegin > 0)
+		{
+			// Skips the line the previous range ends in, the next line starts at rangeBegin or later
+			in.seekg(rangeBegin - 1);
+			std::getline(in, line);
+			offset = rangeBegin + line.size();
+		}
+
+		PlayedGame game;
+		BoardStateData boardStateData;
+		std::string resultTag;
+		std::string resultToken;
+		bool owned = rangeBegin == 0;
+		bool inGame = false;
+		bool inMoves = false;
+		bool valid = true;
+		bool inComment = false;
+		int variationDepth = 0;
+		while (std::getline(in, line))
+		{
+			uint64_t lineStart = offset;
+			offset += line.size() + 1;
+			if (!line.empty() && line.back() == '\r')
+			{
+				line.pop_back();
+			}
+			if (format == ImportFormat::EPD)
+			{
+				if (lineStart >= rangeEnd)
+				{
+					break;
+				}
+				importEpdLine(line);
+				continue;
+			}
+
+			bool tag = !inComment && !line.empty() && line[0] == '[';
+			if (tag && (inMoves || line.compare(0, 7, "[Event ") == 0))
+			{
+				if (inGame)
+				{
+					finishGame(game, valid, knownResult(resultTag) ? resultTag : resultToken);
+					inGame = false;
+				}
+				if (line.compare(0, 7, "[Event ") == 0)
+				{
+					if (lineStart >= rangeEnd)
+					{
+						break;
+					}
+					owned = true;
+				}
+			}
+			if (!owned || line.empty() || line[0] == '%')
+			{
+				continue;
+			}
+			if (!inGame)
+			{
+				game = PlayedGame();
+				worker.resetBoardStateData(game.start);
+				boardStateData.copy(game.start);
+				resultTag.clear();
+				resultToken.clear();
+				inGame = true;
+				inMoves = false;
+				valid = true;
+				inComment = false;
+				variationDepth = 0;
+			}
+
+			if (tag)
+			{
+				size_t nameEnd = line.find(' ');
+				size_t valueBegin = line.find('"');
+				size_t valueEnd = line.rfind('"');
+				if (nameEnd == std::string::npos || valueBegin == std::string::npos || valueEnd <= valueBegin)
+				{
+					continue;
+				}
+				std::string name = line.substr(1, nameEnd - 1);
+				std::string value = line.substr(valueBegin + 1, valueEnd - valueBegin - 1);
+				if (name == "Result")
+				{
+					resultTag = value;
+				}
+				else if (name == "FEN")
+				{
+					valid = valid && parseFen(value, game.start);
+					boardStateData.copy(game.start);
+				}
+				else if (name == "Variant" && value != "Standard" && value != "standard")
+				{
+					valid = false;
+				}
+				continue;
+			}
+
+			inMoves = true;
+			for (size_t i = 0; i < line.size();)
+			{
+				char c = line[i];
+				++i;
+				if (inComment)
+				{
+					inComment = c != '}';
+					continue;
+				}
+				if (c == ';')
+				{
+					break;
+				}
+				if (c == '{' || c == '(' || c == ')' || isspace((unsigned char)c))
+				{
+					inComment = c == '{';
+					variationDepth += c == '(' ? 1 : c == ')' ? -1 : 0;
+					continue;
+				}
+				--i;
+				size_t tokenEnd = line.find_first_of(" \t{}();", i);
+				tokenEnd = tokenEnd == std::string::npos ? line.size() : tokenEnd;
+				std::string token = line.substr(i, tokenEnd - i);
+				i = tokenEnd;
+				if (variationDepth > 0 || token[0] == '$')
+				{
+					continue;
+				}
+				if (knownResult(token) || token == "*")
+				{
+					resultToken = token;
+					continue;
+				}
+				// Move numbers, also when they are glued to the move as in 12.e4 or 12...e5
+				size_t number = token.find_first_not_of("0123456789");
+				if (number == std::string::npos || (number > 0 && token[number] == '.'))
+				{
+					size_t moveBegin = token.find_first_not_of("0123456789.");
+					token = moveBegin == std::string::npos ? "" : token.substr(moveBegin);
+				}
+				if (token.empty() || !valid)
+				{
+					continue;
+				}
+				MoveData move;
+				valid = worker.parseSan(boardStateData, token, move);
+				if (valid)
+				{
+					applyMove(boardStateData, move);
+					game.moves.push_back(move);
+				}
+			}
+		}
+		if (inGame)
+		{
+			finishGame(game, valid, knownResult(resultTag) ? resultTag : resultToken);
+		}
+	}
+
+	// The log holds packed squares and piece codes, so a damaged record could name squares off the board. The start
+	// position goes through FEN and every move has to be one of the legal moves before it is played.
+	void PositionImporter::importGameLog(const std::string& fileName)
+	{
+		GameLogReader reader;
+		reader.open(fileName);
+		int ranges = (int)workers.size();
+		auto work = [&](int range)
+		{
+			BoardManager& worker = *workers[range];
+			BoardStateData boardStateData;
+			for (int g = reader.games() * range / ranges; g < reader.games() * (range + 1) / ranges; ++g)
+			{
+				PlayedGame game = reader.game(g);
+				bool valid = !game.moves.empty() && parseFen(writeFen(game.start), boardStateData);
+				game.start.copy(boardStateData);
+				for (unsigned int i = 0; valid && i < game.moves.size(); ++i)
+				{
+					// The generated move replaces the logged one, so its flags are the generator's as well
+					std::vector<MoveData> legal = worker.legalMoves(boardStateData);
+					auto found = std::find_if(legal.begin(), legal.end(), [&](const MoveData& move) { return sameMove(move, game.moves[i]); });
+					valid = found != legal.end();
+					if (valid)
+					{
+						game.moves[i] = *found;
+						applyMove(boardStateData, game.moves[i]);
+					}
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!valid)
+				{
+					count(0, true);
+					continue;
+				}
+				game.index = (int)stats.games++;
+				if (gameSink)
+				{
+					gameSink(game);
+				}
+				count((long long)game.moves.size(), false);
+			}
+		};
+		std::vector<std::thread> threads;
+		for (int i = 1; i < ranges; ++i)
+		{
+			threads.push_back(std::thread(work, i));
+		}
+		work(0);
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+	}
+
+	// Reads the whole file with every worker on a range of its own and returns when the sinks have seen all of it
+	ImportStats PositionImporter::importFile(const std::string& fileName)
+	{
+		std::ifstream file(fileName, std::ios_base::binary | std::ios_base::ate);
+		if (!file)
+		{
+			throw std::runtime_error(fileName + ": could not open file");
+		}
+		uint64_t bytes = (uint64_t)file.tellg();
+		file.close();
+		if (workers.empty())
+		{
+			init(1);
+		}
+
+		ImportFormat format = importFormat(fileName);
+		stats = ImportStats();
+		reported = 0;
+		begin = std::chrono::steady_clock::now();
+		if (format == ImportFormat::GAME_LOG)
+		{
+			importGameLog(fileName);
+			stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			return stats;
+		}
+		uint64_t ranges = workers.size();
+		std::vector<std::thread> threads;
+		for (uint64_t i = 1; i < ranges; ++i)
+		{
+			threads.push_back(std::thread(&PositionImporter::importRange, this, std::ref(*workers[i]), fileName, format, bytes * i / ranges, bytes * (i + 1) / ranges));
+		}
+		importRange(*workers[0], fileName, format, 0, bytes / ranges);
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		return stats;
+	}
+}
\ No newline at end of file
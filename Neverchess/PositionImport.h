@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include "BoardState.h"
+#include "GameLog.h"
+
+namespace BoardState
+{
+	// Read buffer of every import thread, the importer holds nothing else of the file
+	static const size_t IMPORT_READ_BUFFER = 1 << 20;
+	// Positions between two progress lines
+	static const long long IMPORT_REPORT_INTERVAL = 100000;
+
+	enum class ImportFormat
+	{
+		PGN,
+		EPD,
+		GAME_LOG
+	};
+
+	struct ImportStats
+	{
+		long long games = 0;
+		long long positions = 0;
+		// Games with an unknown result or a move that is not legal, and EPD lines without a result
+		long long skipped = 0;
+		double seconds = 0.0;
+
+		double positionsPerSecond() const { return seconds > 0.0 ? positions / seconds : 0.0; }
+	};
+
+	// Files ending in .epd are EPD, in .games game logs of self-play, everything else is PGN
+	ImportFormat importFormat					(const std::string& fileName);
+
+	// Streams labelled positions out of PGN and EPD files. The file is split into one byte range per thread and every
+	// thread reads its range line by line, so memory does not grow with the file. A PGN game belongs to the range its
+	// [Event tag starts in, an EPD line to the range it starts in. Each PGN game is handed to the game sink with its
+	// result, SAN moves replayed from the start position or its FEN tag. Each EPD line is handed to the position sink
+	// with a label from its c9 opcode or a trailing [1.0] style result. A game log is mapped and its games are split
+	// between the threads, every move is checked against the legal moves before the game goes to the game sink. Sinks
+	// are called one at a time, so they may feed a BoardManager that is not thread safe, and a slow sink holds the
+	// readers back.
+	class PositionImporter
+	{
+	private:
+		std::vector<std::unique_ptr<BoardManager>> workers;
+		std::function<void(const PlayedGame&)> gameSink;
+		std::function<void(const BoardStateData&, float)> positionSink;
+		std::mutex mutex;
+		ImportStats stats;
+		long long reported = 0;
+		std::chrono::steady_clock::time_point begin;
+
+		void importRange						(BoardManager& worker, const std::string& fileName, ImportFormat format, uint64_t rangeBegin, uint64_t rangeEnd);
+		void finishGame							(PlayedGame& game, bool valid, const std::string& result);
+		void importEpdLine						(const std::string& line);
+		void importGameLog						(const std::string& fileName);
+		void count								(long long positions, bool skipped);
+
+	public:
+		void init								(int threads);
+		int threads								() const { return (int)workers.size(); }
+		void setGameSink						(std::function<void(const PlayedGame&)> sink) { gameSink = sink; }
+		void setPositionSink					(std::function<void(const BoardStateData&, float)> sink) { positionSink = sink; }
+		ImportStats importFile					(const std::string& fileName);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "QuantizedNetwork.h"
+#include "BoardState.h"
+#include "Kernels.h"
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace BoardState
+{
+	static int padded(int n)
+	{
+		return (n + AnnUtilities::QUANT_PADDING - 1) / AnnUtilities::QUANT_PADDING * AnnUtilities::QUANT_PADDING;
+	}
+
+	static float largestMagnitude(const float* values, int n)
+	{
+		float largest = 0.0f;
+		for (int i = 0; i < n; ++i)
+		{
+			largest = std::max(largest, fabsf(values[i]));
+		}
+		return largest > 0.0f ? largest : 1.0f;
+	}
+
+	void QuantizedNetwork::quantize(const AnnUtilities::ANNetwork& network)
+	{
+		quantize(AnnUtilities::InferenceNetwork(network, false));
+	}
+
+	// Arena padding is zero, so the largest magnitude can be taken over the padded blocks. Hidden activations are
+	// quantized on the fixed range [-1, 1], so a network whose hidden layers are not tanh or sigmoid is refused.
+	void QuantizedNetwork::quantize(const AnnUtilities::InferenceNetwork& network)
+	{
+		for (int n = 0; n + 1 < network.layerCount(); ++n)
+		{
+			AnnUtilities::ACTFUNC hidden = network.layer(n).actfunc;
+			if (hidden != AnnUtilities::ACTFUNC::TANH && hidden != AnnUtilities::ACTFUNC::SIGMOID)
+			{
+				throw std::runtime_error("the quantized network needs tanh or sigmoid hidden layers");
+			}
+		}
+		const AnnUtilities::ArenaLayer& first = network.layer(0);
+		inputSize = network.inputSize();
+		hiddenSize = first.rows;
+		paddedHidden = padded(hiddenSize);
+		actfunc = first.actfunc;
+
+		// Columns are input-major like the float accumulator so a sparse input sums contiguous columns
+		firstScale = QUANT_FIRST_LAYER_MAX / largestMagnitude(network.at(first.weights), first.paddedRows * inputSize);
+		columns.assign(inputSize * paddedHidden, 0);
+		firstBiases.assign(paddedHidden, 0);
+		for (int i = 0; i < hiddenSize; ++i)
+		{
+			for (int j = 0; j < inputSize; ++j)
+			{
+				columns[j * paddedHidden + i] = (short)lroundf(network.column(j)[i] * firstScale);
+			}
+			firstBiases[i] = (int)lroundf(network.firstBiases()[i] * firstScale);
+		}
+
+		layers.clear();
+		widest = paddedHidden;
+		for (int n = 1; n < network.layerCount(); ++n)
+		{
+			const AnnUtilities::ArenaLayer& l = network.layer(n);
+			const float* weights = network.at(l.weights);
+			const float* biases = network.at(l.biases);
+			QuantizedLayer layer;
+			layer.rows = padded(l.rows);
+			layer.cols = padded(l.cols);
+			layer.scale = QUANT_HIDDEN_MAX / largestMagnitude(weights, l.rows * l.paddedCols);
+			layer.actfunc = l.actfunc;
+			layer.weights.assign(layer.rows * layer.cols, 0);
+			layer.biases.assign(layer.rows, 0.0f);
+			for (int i = 0; i < l.rows; ++i)
+			{
+				for (int j = 0; j < l.cols; ++j)
+				{
+					layer.weights[i * layer.cols + j] = (signed char)lroundf(weights[i * l.paddedCols + j] * layer.scale);
+				}
+				layer.biases[i] = biases[i];
+			}
+			widest = std::max(widest, layer.rows);
+			layers.push_back(layer);
+		}
+	}
+
+	void QuantizedNetwork::prepare(QuantizedScratch& scratch) const
+	{
+		scratch.sums.resize(widest);
+		scratch.values.resize(widest);
+		scratch.activations[0].resize(widest);
+		scratch.activations[1].resize(widest);
+	}
+
+	static void quantizeActivations(const float* source, signed char* target, int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			float v = std::min(1.0f, std::max(-1.0f, source[i]));
+			target[i] = (signed char)lroundf(v * QUANT_HIDDEN_MAX);
+		}
+	}
+
+	// Returns the network output for the position, the same value the float network gives up to quantization error
+	float QuantizedNetwork::evaluate(const BoardStateData& boardStateData, QuantizedScratch& scratch) const
+	{
+		if ((int)scratch.sums.size() < widest)
+		{
+			prepare(scratch);
+		}
+		const AnnUtilities::KernelTable& k = AnnUtilities::kernels();
+		int* sums = &scratch.sums[0];
+		float* values = &scratch.values[0];
+		int active[ANN_MAX_ACTIVE_INPUTS];
+		int count = activeANNInputs(boardStateData, active, ANN_MAX_ACTIVE_INPUTS);
+		std::copy(firstBiases.begin(), firstBiases.end(), sums);
+		for (int i = 0; i < count; ++i)
+		{
+			k.addInt16(sums, &columns[active[i] * paddedHidden], paddedHidden);
+		}
+		for (int i = 0; i < paddedHidden; ++i)
+		{
+			values[i] = sums[i] / firstScale;
+		}
+		k.activate(actfunc, values, paddedHidden);
+
+		// Padded activations may be non-zero, their weights in the next layer are zero
+		int current = 0;
+		quantizeActivations(values, &scratch.activations[current][0], paddedHidden);
+		for (const QuantizedLayer& layer : layers)
+		{
+			k.gemvInt8(&layer.weights[0], &scratch.activations[current][0], sums, layer.rows, layer.cols);
+			float dequantize = 1.0f / (layer.scale * QUANT_HIDDEN_MAX);
+			for (int i = 0; i < layer.rows; ++i)
+			{
+				values[i] = sums[i] * dequantize + layer.biases[i];
+			}
+			k.activate(layer.actfunc, values, layer.rows);
+			current = 1 - current;
+			quantizeActivations(values, &scratch.activations[current][0], layer.rows);
+		}
+		// The output itself is returned unquantized
+		return values[0];
+	}
+
+	// Compares the quantized network against the float network it was made from
+	QuantizationReport validateQuantization(const QuantizedNetwork& quantized, const AnnUtilities::ANNetwork& network, const std::vector<BoardStateData>& positions)
+	{
+		QuantizationReport report;
+		AnnUtilities::InferenceNetwork reference(network, false);
+		EvaluationScratch scratch;
+		QuantizedScratch quantizedScratch;
+		double total = 0.0;
+		for (const BoardStateData& position : positions)
+		{
+			float error = fabsf(quantized.evaluate(position, quantizedScratch) - evaluate(reference, position, scratch));
+			total += error;
+			report.maxError = std::max(report.maxError, error);
+		}
+		report.positions = (int)positions.size();
+		report.meanError = positions.empty() ? 0.0f : (float)(total / positions.size());
+		return report;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <ANNetwork.h>
+#include <Layer.h>
+#include "InferenceNetwork.h"
+
+namespace BoardState
+{
+	struct BoardStateData;
+
+	// Largest magnitude of a quantized first layer weight and of a quantized hidden weight or activation
+	static const int QUANT_FIRST_LAYER_MAX = 32767;
+	static const int QUANT_HIDDEN_MAX = 127;
+
+	// Integer and float activations of one thread evaluating a QuantizedNetwork
+	struct QuantizedScratch
+	{
+		std::vector<int> sums;
+		std::vector<float> values;
+		std::vector<signed char> activations[2];
+	};
+
+	struct QuantizationReport
+	{
+		int positions = 0;
+		float meanError = 0.0f;
+		float maxError = 0.0f;
+	};
+
+	// Post-training int16/int8 copy of a network for search. The first hidden layer keeps int16 weight columns that
+	// are summed over the active inputs into int32, later layers multiply int8 weights with int8 activations. Each
+	// layer has its own scale taken from its largest weight, activations are clamped to [-1, 1] before quantizing,
+	// which is exact for tanh and sigmoid, so quantize throws for other hidden activations. Rows and columns are zero
+	// padded to AnnUtilities::QUANT_PADDING. It is made from a training network or from the read-only weights of a
+	// model file. The copy does not follow training, quantize has to be called again after the weights change.
+	// Evaluation only writes the caller's scratch, so threads can share one quantized network.
+	class QuantizedNetwork
+	{
+	private:
+		struct QuantizedLayer
+		{
+			int rows = 0;
+			int cols = 0;
+			float scale = 1.0f;
+			AnnUtilities::ACTFUNC actfunc = AnnUtilities::ACTFUNC::TANH;
+			std::vector<signed char> weights;
+			std::vector<float> biases;
+		};
+
+		int inputSize = 0;
+		int hiddenSize = 0;
+		int paddedHidden = 0;
+		float firstScale = 1.0f;
+		AnnUtilities::ACTFUNC actfunc = AnnUtilities::ACTFUNC::TANH;
+		std::vector<short> columns;
+		std::vector<int> firstBiases;
+		std::vector<QuantizedLayer> layers;
+		int widest = 0;
+
+	public:
+		bool empty								() const { return layers.empty(); }
+		void quantize							(const AnnUtilities::ANNetwork& network);
+		void quantize							(const AnnUtilities::InferenceNetwork& network);
+		void prepare							(QuantizedScratch& scratch) const;
+		float evaluate							(const BoardStateData& boardStateData, QuantizedScratch& scratch) const;
+	};
+
+	QuantizationReport validateQuantization		(const QuantizedNetwork& quantized, const AnnUtilities::ANNetwork& network, const std::vector<BoardStateData>& positions);
+}
\ No newline at end of file
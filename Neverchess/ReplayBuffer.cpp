@@ -0,0 +1,180 @@
+#include "ReplayBuffer.h"
+#include "BoardState.h"
+#include "Checkpoint.h"
+#include <math.h>
+#include <algorithm>
+
+namespace BoardState
+{
+	unsigned char packPiece(PieceCode piece)
+	{
+		int bits = (int)piece & 0b0111111;
+		unsigned char code = 0;
+		while (bits != 0)
+		{
+			++code;
+			bits >>= 1;
+		}
+		return ((int)piece & 0b1000000) ? code + 8 : code;
+	}
+
+	PieceCode unpackPiece(unsigned char code)
+	{
+		if ((code & 7) == 0)
+		{
+			return PieceCode::EMPTY;
+		}
+		int piece = 1 << ((code & 7) - 1);
+		return (PieceCode)(code & 8 ? piece | 0b1000000 : piece);
+	}
+
+	void packPosition(const BoardStateData& boardStateData, PackedPosition& packed)
+	{
+		for (int i = 0; i < 32; ++i)
+		{
+			packed.squares[i] = packPiece(boardStateData._pieces[i * 2]) | (packPiece(boardStateData._pieces[i * 2 + 1]) << 4);
+		}
+		packed.flags = (unsigned char)(boardStateData._turn
+			| boardStateData._kingMoved[0] << 1 | boardStateData._kingMoved[1] << 2
+			| boardStateData._kRookMoved[0] << 3 | boardStateData._kRookMoved[1] << 4
+			| boardStateData._qRookMoved[0] << 5 | boardStateData._qRookMoved[1] << 6);
+		packed.enPassant = (signed char)boardStateData._enPassant;
+	}
+
+	void unpackPosition(const PackedPosition& packed, BoardStateData& boardStateData)
+	{
+		for (int i = 0; i < 32; ++i)
+		{
+			boardStateData._pieces[i * 2] = unpackPiece(packed.squares[i] & 15);
+			boardStateData._pieces[i * 2 + 1] = unpackPiece(packed.squares[i] >> 4);
+		}
+		boardStateData._turn = packed.flags & 1;
+		boardStateData._kingMoved[0] = (packed.flags >> 1) & 1;
+		boardStateData._kingMoved[1] = (packed.flags >> 2) & 1;
+		boardStateData._kRookMoved[0] = (packed.flags >> 3) & 1;
+		boardStateData._kRookMoved[1] = (packed.flags >> 4) & 1;
+		boardStateData._qRookMoved[0] = (packed.flags >> 5) & 1;
+		boardStateData._qRookMoved[1] = (packed.flags >> 6) & 1;
+		boardStateData._enPassant = packed.enPassant;
+		boardStateData._halfmoveClock = 0;
+	}
+
+	// All memory is allocated here, adding and sampling never allocate
+	void ReplayBuffer::init(int capacity, unsigned int seed)
+	{
+		entries.resize(capacity);
+		leaves = 1;
+		while (leaves < capacity)
+		{
+			leaves *= 2;
+		}
+		priorities.assign(leaves * 2, 0.0f);
+		next = 0;
+		count = 0;
+		maxPriority = 1.0f;
+		random.seed(seed);
+	}
+
+	// Leaves of the sum tree start at leaves, every inner node holds the sum of its two children
+	void ReplayBuffer::setPriority(int index, float priority)
+	{
+		int node = leaves + index;
+		priorities[node] = priority;
+		for (node /= 2; node >= 1; node /= 2)
+		{
+			priorities[node] = priorities[node * 2] + priorities[node * 2 + 1];
+		}
+	}
+
+	int ReplayBuffer::findPriority(float value) const
+	{
+		int node = 1;
+		while (node < leaves)
+		{
+			if (value < priorities[node * 2] || priorities[node * 2 + 1] <= 0.0f)
+			{
+				node = node * 2;
+			}
+			else
+			{
+				value -= priorities[node * 2];
+				node = node * 2 + 1;
+			}
+		}
+		return std::min(node - leaves, count - 1);
+	}
+
+	void ReplayBuffer::add(const BoardStateData& boardStateData, float label)
+	{
+		ReplayEntry& entry = entries[next];
+		packPosition(boardStateData, entry.position);
+		entry.label = label;
+		setPriority(next, maxPriority);
+		next = (next + 1) % capacity();
+		count = std::min(count + 1, capacity());
+	}
+
+	// Draws samples positions with replacement and fills batch with pointers into positions. The ring indices of the
+	// samples are kept so that their priorities can be updated after training.
+	void ReplayBuffer::sample(int samples, ReplaySampling mode, std::vector<BoardStateData>& positions, std::vector<TrainingSample>& batch, std::vector<int>& indices)
+	{
+		positions.resize(samples);
+		batch.resize(samples);
+		indices.resize(samples);
+		std::uniform_int_distribution<int> uniform(0, std::max(0, count - 1));
+		std::uniform_real_distribution<float> proportional(0.0f, priorities[1]);
+		for (int i = 0; i < samples; ++i)
+		{
+			int index = mode == ReplaySampling::PRIORITIZED ? findPriority(proportional(random)) : uniform(random);
+			indices[i] = index;
+			unpackPosition(entries[index].position, positions[i]);
+			batch[i].position = &positions[i];
+			batch[i].label = entries[index].label;
+		}
+	}
+
+	void ReplayBuffer::updatePriorities(const std::vector<int>& indices, const float* errors, int samples)
+	{
+		for (int i = 0; i < samples; ++i)
+		{
+			float priority = powf(fabsf(errors[i]) + REPLAY_PRIORITY_EPSILON, REPLAY_PRIORITY_EXPONENT);
+			maxPriority = std::max(maxPriority, priority);
+			setPriority(indices[i], priority);
+		}
+	}
+
+	// The filled part of the ring, the sum tree and the random engine, so that a restored buffer draws the same
+	// samples. Until the ring wraps around the filled part is its first count entries.
+	void ReplayBuffer::save(std::ostream& out) const
+	{
+		checkpointWrite(out, (int32_t)capacity());
+		checkpointWrite(out, (int32_t)leaves);
+		checkpointWrite(out, (int32_t)next);
+		checkpointWrite(out, (int32_t)count);
+		checkpointWrite(out, maxPriority);
+		checkpointWrite(out, entries.data(), count);
+		checkpointWriteVector(out, priorities);
+		checkpointWriteEngine(out, random);
+	}
+
+	void ReplayBuffer::restore(std::istream& in)
+	{
+		int size = checkpointRead<int32_t>(in);
+		leaves = checkpointRead<int32_t>(in);
+		next = checkpointRead<int32_t>(in);
+		count = checkpointRead<int32_t>(in);
+		maxPriority = checkpointRead<float>(in);
+		if (size < 0 || count < 0 || count > size || size > leaves)
+		{
+			throw std::runtime_error("Checkpoint holds an inconsistent replay buffer");
+		}
+		entries.resize(size);
+		checkpointRead(in, entries.data(), count);
+		checkpointReadVector(in, priorities);
+		checkpointReadEngine(in, random);
+		if ((int)priorities.size() != leaves * 2)
+		{
+			throw std::runtime_error("Checkpoint holds an inconsistent replay buffer");
+		}
+	}
+}
\ No newline at end of file
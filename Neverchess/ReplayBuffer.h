@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <random>
+#include <iosfwd>
+#include "Trainer.h"
+#include "PieceCode.h"
+
+namespace BoardState
+{
+	struct BoardStateData;
+
+	static const int REPLAY_CAPACITY = 1 << 18;
+	static const int REPLAY_BATCHES_PER_GAME = 4;
+	// Priorities are (|error| + epsilon)^exponent, the epsilon keeps well learned positions from never coming back
+	static const float REPLAY_PRIORITY_EXPONENT = 0.6f;
+	static const float REPLAY_PRIORITY_EPSILON = 0.01f;
+
+	enum class ReplaySampling
+	{
+		UNIFORM,
+		PRIORITIZED
+	};
+
+	// A position in 34 bytes: a 4 bit code for every square, the castling flags and the en passant column.
+	// Square codes are 0 for empty, 1 to 6 for the white king, queen, pawn, knight, bishop and rook and 8 more for black.
+	struct PackedPosition
+	{
+		unsigned char squares[32];
+		unsigned char flags;
+		signed char enPassant;
+	};
+
+	unsigned char packPiece						(PieceCode piece);
+	PieceCode unpackPiece						(unsigned char code);
+	void packPosition							(const BoardStateData& boardStateData, PackedPosition& packed);
+	void unpackPosition							(const PackedPosition& packed, BoardStateData& boardStateData);
+
+	struct ReplayEntry
+	{
+		PackedPosition position;
+		float label;
+	};
+
+	// Fixed capacity ring of labelled positions from the last games, the oldest positions are overwritten first.
+	// Prioritized sampling draws positions in proportion to their priority from a sum tree over the ring, new
+	// positions get the largest priority seen so far so that each is likely to be trained at least once.
+	class ReplayBuffer
+	{
+	private:
+		std::vector<ReplayEntry> entries;
+		std::vector<float> priorities;
+		int leaves = 0;
+		int next = 0;
+		int count = 0;
+		float maxPriority = 1.0f;
+		std::mt19937 random;
+
+		void setPriority						(int index, float priority);
+		int findPriority						(float value) const;
+
+	public:
+		void init								(int capacity, unsigned int seed);
+		bool empty								() const { return count == 0; }
+		int size								() const { return count; }
+		int capacity							() const { return (int)entries.size(); }
+		void add								(const BoardStateData& boardStateData, float label);
+		void sample								(int samples, ReplaySampling mode, std::vector<BoardStateData>& positions, std::vector<TrainingSample>& batch, std::vector<int>& indices);
+		void updatePriorities					(const std::vector<int>& indices, const float* errors, int samples);
+		void save								(std::ostream& out) const;
+		void restore							(std::istream& in);
+	};
+}
\ No newline at end of file
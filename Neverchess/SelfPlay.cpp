@@ -0,0 +1,185 @@
+#include "SelfPlay.h"
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+namespace BoardState
+{
+	void GameQueue::push(PlayedGame&& game)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			games.push_back(std::move(game));
+		}
+		ready.notify_one();
+	}
+
+	// Waits for a game when the queue is empty
+	PlayedGame GameQueue::pop()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		ready.wait(lock, [this]() { return !games.empty(); });
+		PlayedGame game = std::move(games.front());
+		games.pop_front();
+		return game;
+	}
+
+	bool GameQueue::tryPop(PlayedGame& game)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (games.empty())
+		{
+			return false;
+		}
+		game = std::move(games.front());
+		games.pop_front();
+		return true;
+	}
+
+	int GameQueue::size()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return (int)games.size();
+	}
+
+	// Workers hash with the keys of the learner's manager, the ones a checkpoint stores and restores
+	void SelfPlay::init(int threads, const BoardManager& keys)
+	{
+		workers.resize(std::max(1, threads));
+		for (std::unique_ptr<BoardManager>& worker : workers)
+		{
+			if (!worker)
+			{
+				worker.reset(new BoardManager());
+				worker->copyZobristValues(keys);
+				worker->setVerbose(false);
+				worker->setAdjudication(adjudication);
+				worker->setSearchMode(searchMode, playouts);
+				// Every worker plays its own game, so a search keeps to its own thread
+				worker->setSearchThreads(1);
+			}
+		}
+	}
+
+	void SelfPlay::setSearch(int depth, int turns)
+	{
+		evaluationDepth = depth;
+		maxTurns = turns;
+	}
+
+	// Moves are chosen by MCTS with playoutCount playouts instead of the alpha-beta search of setSearch
+	void SelfPlay::setSearchMode(SearchMode mode, int playoutCount)
+	{
+		searchMode = mode;
+		playouts = playoutCount;
+		for (std::unique_ptr<BoardManager>& worker : workers)
+		{
+			worker->setSearchMode(mode, playoutCount);
+		}
+	}
+
+	void SelfPlay::setAdjudication(const AdjudicationSettings& settings)
+	{
+		adjudication = settings;
+		for (std::unique_ptr<BoardManager>& worker : workers)
+		{
+			worker->setAdjudication(settings);
+		}
+	}
+
+	SelfPlay::~SelfPlay()
+	{
+		stop();
+	}
+
+	void SelfPlay::playGame(BoardManager& worker, BoardStateData& board)
+	{
+		worker.resetBoardStateData(board);
+		int index = started++;
+		// Audits follow the game numbers, so a round plays the same games to the end whichever worker takes them
+		worker.auditNextGame(adjudication.auditInterval > 0 && index % adjudication.auditInterval == 0);
+		worker.process(board, *source, evaluationDepth, maxTurns);
+		PlayedGame game = worker.finishGame();
+		game.index = index;
+		worker.reset();
+		queue.push(std::move(game));
+	}
+
+	// Plays count games with the current weights of network and returns when all of them are in the queue. Workers
+	// take the next game as soon as they finish one, so a long game does not hold up the others.
+	void SelfPlay::playRound(AnnUtilities::ANNetwork& network, int count)
+	{
+		source = &network;
+		std::shared_ptr<const AnnUtilities::InferenceNetwork> shared = std::make_shared<const AnnUtilities::InferenceNetwork>(network, false);
+		for (std::unique_ptr<BoardManager>& worker : workers)
+		{
+			worker->shareNetwork(network, shared);
+		}
+		std::atomic<int> next(0);
+		auto play = [&](BoardManager* worker)
+		{
+			BoardStateData board;
+			while (next++ < count)
+			{
+				playGame(*worker, board);
+			}
+		};
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < workers.size(); ++i)
+		{
+			threads.push_back(std::thread(play, workers[i].get()));
+		}
+		play(workers[0].get());
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+	}
+
+	// Replaces the weights the actors start their next games with, games in progress finish with the old ones
+	void SelfPlay::publish(const AnnUtilities::ANNetwork& network)
+	{
+		std::atomic_store(&published, std::make_shared<const AnnUtilities::InferenceNetwork>(network, false));
+	}
+
+	void SelfPlay::act(BoardManager* worker)
+	{
+		std::shared_ptr<const AnnUtilities::InferenceNetwork> current;
+		BoardStateData board;
+		while (running.load(std::memory_order_relaxed))
+		{
+			std::shared_ptr<const AnnUtilities::InferenceNetwork> latest = std::atomic_load(&published);
+			if (latest != current)
+			{
+				current = latest;
+				worker->shareNetwork(*source, current);
+			}
+			playGame(*worker, board);
+		}
+	}
+
+	// Publishes the current weights of network and starts one actor per worker. The learner keeps training network and
+	// publishes it again from time to time.
+	void SelfPlay::start(AnnUtilities::ANNetwork& network)
+	{
+		stop();
+		source = &network;
+		publish(network);
+		running = true;
+		for (std::unique_ptr<BoardManager>& worker : workers)
+		{
+			actors.push_back(std::thread(&SelfPlay::act, this, worker.get()));
+		}
+	}
+
+	// Lets every actor finish its game and joins them, the finished games stay in the queue
+	void SelfPlay::stop()
+	{
+		running = false;
+		for (std::thread& actor : actors)
+		{
+			actor.join();
+		}
+		actors.clear();
+	}
+}
\ No newline at end of file
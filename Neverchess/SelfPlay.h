@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <ANNetwork.h>
+#include "BoardState.h"
+
+namespace BoardState
+{
+	// Finished games waiting to be trained on, filled by the self-play workers
+	class GameQueue
+	{
+	private:
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::deque<PlayedGame> games;
+
+	public:
+		void push								(PlayedGame&& game);
+		PlayedGame pop							();
+		bool tryPop								(PlayedGame& game);
+		int size								();
+	};
+
+	// Training batches between two weight snapshots published to the actors unless setPublishInterval says otherwise
+	static const int SELF_PLAY_PUBLISH_INTERVAL = 16;
+
+	// Plays games on several threads at once. Every worker is a BoardManager of its own, so boards, search history,
+	// transposition tables and accumulators are private, while the weights are one read-only InferenceNetwork that all
+	// workers share. Games are numbered in the order they were started and pushed into the queue as they finish.
+	// playRound plays a fixed number of games with the current weights. start runs the workers as actors that play
+	// until stop, each game with the newest snapshot a learner has published. Snapshots are swapped in atomically and
+	// freed by the last worker that still plays with them, so neither side waits for the other.
+	class SelfPlay
+	{
+	private:
+		std::vector<std::unique_ptr<BoardManager>> workers;
+		std::vector<std::thread> actors;
+		GameQueue queue;
+		std::shared_ptr<const AnnUtilities::InferenceNetwork> published;
+		// Only identifies the published weights to the workers' accumulators, actors never read its layers
+		AnnUtilities::ANNetwork* source = nullptr;
+		std::atomic<bool> running{ false };
+		std::atomic<int> started{ 0 };
+		int evaluationDepth = 2;
+		int maxTurns = 1000;
+		SearchMode searchMode = SearchMode::ALPHA_BETA;
+		int playouts = 800;
+		int publishBatches = SELF_PLAY_PUBLISH_INTERVAL;
+		AdjudicationSettings adjudication;
+
+		void playGame							(BoardManager& worker, BoardStateData& board);
+		void act								(BoardManager* worker);
+
+	public:
+		SelfPlay								() = default;
+		SelfPlay								(const SelfPlay&) = delete;
+		SelfPlay& operator=						(const SelfPlay&) = delete;
+		~SelfPlay								();
+
+		void init								(int threads, const BoardManager& keys);
+		void setSearch							(int depth, int turns);
+		void setSearchMode						(SearchMode mode, int playoutCount);
+		void setAdjudication					(const AdjudicationSettings& settings);
+		void setPublishInterval					(int batches) { publishBatches = std::max(1, batches); }
+		int publishInterval						() const { return publishBatches; }
+		int threads								() const { return (int)workers.size(); }
+		GameQueue& games						() { return queue; }
+		void playRound							(AnnUtilities::ANNetwork& network, int count);
+		void publish							(const AnnUtilities::ANNetwork& network);
+		void start								(AnnUtilities::ANNetwork& network);
+		void stop								();
+	};
+}
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "SnapshotWriter.h"
+#include <stdexcept>
+#include <cstring>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace AnnUtilities
+{
+#ifdef _WIN32
+	void writeFileAtomically(const std::string& fileName, const char* data, size_t bytes, SyncPolicy policy)
+	{
+		std::string temporary = fileName + ".tmp";
+		HANDLE file = CreateFileA(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error(temporary + ": could not create file");
+		}
+		bool written = true;
+		while (written && bytes > 0)
+		{
+			DWORD chunk = bytes > (1u << 30) ? (1u << 30) : (DWORD)bytes;
+			DWORD done = 0;
+			written = WriteFile(file, data, chunk, &done, nullptr) != 0 && done == chunk;
+			data += chunk;
+			bytes -= chunk;
+		}
+		if (written && policy != SyncPolicy::NONE)
+		{
+			written = FlushFileBuffers(file) != 0;
+		}
+		CloseHandle(file);
+		DWORD flags = MOVEFILE_REPLACE_EXISTING | (policy == SyncPolicy::DIRECTORY ? MOVEFILE_WRITE_THROUGH : 0);
+		if (!written || MoveFileExA(temporary.c_str(), fileName.c_str(), flags) == 0)
+		{
+			DeleteFileA(temporary.c_str());
+			throw std::runtime_error(fileName + ": could not write file");
+		}
+	}
+#else
+	void writeFileAtomically(const std::string& fileName, const char* data, size_t bytes, SyncPolicy policy)
+	{
+		std::string temporary = fileName + ".tmp";
+		int file = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (file < 0)
+		{
+			throw std::runtime_error(temporary + ": could not create file");
+		}
+		bool written = true;
+		while (written && bytes > 0)
+		{
+			ssize_t done = write(file, data, bytes);
+			written = done > 0;
+			if (written)
+			{
+				data += done;
+				bytes -= (size_t)done;
+			}
+		}
+		if (written && policy != SyncPolicy::NONE)
+		{
+			written = fsync(file) == 0;
+		}
+		written = close(file) == 0 && written;
+		if (!written || rename(temporary.c_str(), fileName.c_str()) != 0)
+		{
+			unlink(temporary.c_str());
+			throw std::runtime_error(fileName + ": could not write file");
+		}
+		if (policy == SyncPolicy::DIRECTORY)
+		{
+			size_t slash = fileName.find_last_of('/');
+			std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : fileName.substr(0, slash);
+			int handle = open(directory.c_str(), O_RDONLY);
+			if (handle >= 0)
+			{
+				fsync(handle);
+				close(handle);
+			}
+		}
+	}
+#endif
+
+	SnapshotBuffer::int_type SnapshotBuffer::overflow(int_type c)
+	{
+		if (c != traits_type::eof())
+		{
+			data.push_back((char)c);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	std::streamsize SnapshotBuffer::xsputn(const char* s, std::streamsize n)
+	{
+		data.insert(data.end(), s, s + n);
+		return n;
+	}
+
+	SnapshotWriter::~SnapshotWriter()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_one();
+		if (worker.joinable())
+		{
+			worker.join();
+		}
+	}
+
+	void SnapshotWriter::setSyncPolicy(SyncPolicy syncPolicy)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		policy = syncPolicy;
+	}
+
+	// An empty buffer that keeps the capacity of an image written before
+	std::vector<char> SnapshotWriter::acquire()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<char> buffer;
+		if (!spare.empty())
+		{
+			buffer.swap(spare.back());
+			spare.pop_back();
+		}
+		buffer.clear();
+		return buffer;
+	}
+
+	void SnapshotWriter::submit(const std::string& fileName, std::vector<char>&& data, void (*seal)(std::vector<char>& data))
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			throwError();
+			bool replaced = false;
+			for (Job& job : jobs)
+			{
+				if (job.fileName == fileName)
+				{
+					job.data.swap(data);
+					job.seal = seal;
+					spare.push_back(std::move(data));
+					replaced = true;
+					break;
+				}
+			}
+			if (!replaced)
+			{
+				jobs.push_back(Job());
+				jobs.back().fileName = fileName;
+				jobs.back().data = std::move(data);
+				jobs.back().seal = seal;
+			}
+			if (!worker.joinable())
+			{
+				worker = std::thread(&SnapshotWriter::run, this);
+			}
+		}
+		wake.notify_one();
+	}
+
+	// Waits until every submitted image is on disk
+	void SnapshotWriter::flush()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [this]() { return jobs.empty() && !writing; });
+		throwError();
+	}
+
+	// Called with the mutex held
+	void SnapshotWriter::throwError()
+	{
+		if (!error.empty())
+		{
+			std::string message;
+			message.swap(error);
+			throw std::runtime_error(message);
+		}
+	}
+
+	void SnapshotWriter::run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+			{
+				return;
+			}
+			Job job = std::move(jobs.front());
+			jobs.pop_front();
+			writing = true;
+			SyncPolicy syncPolicy = policy;
+			lock.unlock();
+			std::string failure;
+			try
+			{
+				if (job.seal != nullptr)
+				{
+					job.seal(job.data);
+				}
+				writeFileAtomically(job.fileName, job.data.data(), job.data.size(), syncPolicy);
+			}
+			catch (std::exception& e)
+			{
+				failure = e.what();
+			}
+			lock.lock();
+			if (!failure.empty() && error.empty())
+			{
+				error = failure;
+			}
+			spare.push_back(std::move(job.data));
+			writing = false;
+			if (jobs.empty())
+			{
+				idle.notify_all();
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <streambuf>
+
+namespace AnnUtilities
+{
+	// How far a finished write is pushed to the disk. A renamed file always survives the process dying, FILE also
+	// syncs the data before the rename and DIRECTORY the rename itself, so the file survives the machine going down.
+	enum class SyncPolicy
+	{
+		NONE,
+		FILE,
+		DIRECTORY
+	};
+
+	// Writes data to fileName + ".tmp" and renames it over fileName, so readers see the old file or the whole new one
+	void writeFileAtomically					(const std::string& fileName, const char* data, size_t bytes, SyncPolicy policy);
+
+	// Stream buffer that appends to a vector, so images can be serialized into recycled memory
+	class SnapshotBuffer : public std::streambuf
+	{
+	private:
+		std::vector<char>& data;
+
+	protected:
+		int_type overflow						(int_type c) override;
+		std::streamsize xsputn					(const char* s, std::streamsize n) override;
+
+	public:
+		explicit SnapshotBuffer					(std::vector<char>& target) : data(target) {}
+	};
+
+	// Writes file images on a background thread. The caller copies what it wants written into a buffer from acquire
+	// and hands it to submit, the thread optionally finishes the image with seal, writes it atomically and keeps the
+	// buffer for the next acquire, so a steady stream of snapshots allocates nothing. A queued image is replaced by a
+	// newer one for the same file. Errors of the thread are thrown by the next submit or flush.
+	class SnapshotWriter
+	{
+	private:
+		struct Job
+		{
+			std::string fileName;
+			std::vector<char> data;
+			void (*seal)(std::vector<char>& data) = nullptr;
+		};
+
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable idle;
+		std::deque<Job> jobs;
+		std::vector<std::vector<char>> spare;
+		std::string error;
+		SyncPolicy policy = SyncPolicy::DIRECTORY;
+		bool writing = false;
+		bool stopping = false;
+
+		void run								();
+		void throwError							();
+
+	public:
+		SnapshotWriter							() = default;
+		SnapshotWriter							(const SnapshotWriter&) = delete;
+		SnapshotWriter& operator=				(const SnapshotWriter&) = delete;
+		~SnapshotWriter							();
+
+		void setSyncPolicy						(SyncPolicy syncPolicy);
+		std::vector<char> acquire				();
+		void submit								(const std::string& fileName, std::vector<char>&& data, void (*seal)(std::vector<char>& data));
+		void flush								();
+	};
+}
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include "Trainer.h"
+#include "BoardState.h"
+#include "Kernels.h"
+#include "Checkpoint.h"
+#include <cstring>
+#include <algorithm>
+#include <thread>
+
+namespace BoardState
+{
+	// Weight gradients when region is 0, bias gradients when it is 1
+	static float* gradientRegion(AnnUtilities::NetworkArena& buffers, int layer, int region, size_t* size)
+	{
+		const AnnUtilities::ArenaLayer& l = buffers.layer(layer);
+		*size = region == 0 ? (size_t)l.paddedCols * l.paddedRows : (size_t)l.paddedRows;
+		return buffers.at(region == 0 ? l.weightGradients : l.biasGradients);
+	}
+
+	void Trainer::setBatchSize(int size)
+	{
+		batchSize = std::max(1, size);
+	}
+
+	void Trainer::setThreads(int count)
+	{
+		count = std::max(1, count);
+		if (count != threads)
+		{
+			stopHelpers();
+			threads = count;
+		}
+		startHelpers();
+	}
+
+	Trainer::~Trainer()
+	{
+		stopHelpers();
+	}
+
+	void Trainer::startHelpers()
+	{
+		for (int i = (int)helpers.size() + 1; i < threads; ++i)
+		{
+			helpers.push_back(std::thread(&Trainer::help, this, i));
+		}
+	}
+
+	void Trainer::stopHelpers()
+	{
+		{
+			std::lock_guard<std::mutex> lock(poolMutex);
+			quitting = true;
+		}
+		wake.notify_all();
+		for (std::thread& helper : helpers)
+		{
+			helper.join();
+		}
+		helpers.clear();
+		quitting = false;
+	}
+
+	// Waits for every job and runs its part of it, a job with fewer parts leaves this helper idle
+	void Trainer::help(int part)
+	{
+		unsigned int seen = 0;
+		std::unique_lock<std::mutex> lock(poolMutex);
+		while (true)
+		{
+			wake.wait(lock, [&]() { return quitting || generation != seen; });
+			if (quitting)
+			{
+				return;
+			}
+			seen = generation;
+			if (part < jobParts)
+			{
+				lock.unlock();
+				job(part);
+				lock.lock();
+				if (--pendingParts == 0)
+				{
+					done.notify_one();
+				}
+			}
+		}
+	}
+
+	// Runs f(0) to f(parts - 1), f(0) and the parts without a helper on the calling thread, the others on the helpers
+	void Trainer::runParallel(int parts, const std::function<void(int)>& f)
+	{
+		int shared = std::min(parts, (int)helpers.size() + 1);
+		if (shared > 1)
+		{
+			{
+				std::lock_guard<std::mutex> lock(poolMutex);
+				job = f;
+				jobParts = shared;
+				pendingParts = shared - 1;
+				++generation;
+			}
+			wake.notify_all();
+		}
+		f(0);
+		for (int i = shared; i < parts; ++i)
+		{
+			f(i);
+		}
+		if (shared > 1)
+		{
+			std::unique_lock<std::mutex> lock(poolMutex);
+			done.wait(lock, [this]() { return pendingParts == 0; });
+		}
+	}
+
+	// Copies the network into the arena, momentum is kept while the layout stays the same. Shard 0 uses the buffers
+	// of the arena itself, the other shards get arenas without parameters.
+	void Trainer::load(const AnnUtilities::ANNetwork& network)
+	{
+		arena.allocate(network._settings, AnnUtilities::ArenaContents::TRAINING, shardCapacity(), false);
+		arena.load(network);
+		shards.resize(threads);
+		for (int i = 0; i < threads; ++i)
+		{
+			if (!shards[i])
+			{
+				shards[i].reset(new TrainerShard());
+			}
+			TrainerShard& shard = *shards[i];
+			if (i == 0)
+			{
+				shard.buffers = &arena;
+			}
+			else
+			{
+				shard.owned.allocate(network._settings, AnnUtilities::ArenaContents::GRADIENTS, shardCapacity(), false);
+				shard.buffers = &shard.owned;
+			}
+			shard.active.resize(shardCapacity() * ANN_MAX_ACTIVE_INPUTS);
+			shard.activeCounts.resize(shardCapacity());
+		}
+	}
+
+	void Trainer::store(AnnUtilities::ANNetwork& network) const
+	{
+		arena.store(network);
+	}
+
+	// Writes the batch size, thread count, weights and momentum. Both counts change the order of the additions, so a
+	// restored trainer uses the saved ones to continue with the same weights it would have had.
+	void Trainer::save(std::ostream& out) const
+	{
+		checkpointWrite(out, (int32_t)batchSize);
+		checkpointWrite(out, (int32_t)threads);
+		checkpointWrite(out, (uint8_t)!arena.empty());
+		if (!arena.empty())
+		{
+			arena.writeState(out);
+		}
+	}
+
+	// The next load keeps the restored momentum as long as the network has the same settings
+	void Trainer::restore(std::istream& in, const AnnUtilities::ANNSettings& settings)
+	{
+		setBatchSize(checkpointRead<int32_t>(in));
+		setThreads(checkpointRead<int32_t>(in));
+		if (checkpointRead<uint8_t>(in) != 0)
+		{
+			arena.allocate(settings, AnnUtilities::ArenaContents::TRAINING, shardCapacity(), false);
+			arena.readState(in);
+		}
+	}
+
+	// Padded outputs have to be zero, otherwise they would train the zero padding of the next layer's weights
+	void Trainer::clearPadding(float* values, int rows, int paddedRows, int count)
+	{
+		for (int b = 0; b < count; ++b)
+		{
+			std::fill(values + b * paddedRows + rows, values + (b + 1) * paddedRows, 0.0f);
+		}
+	}
+
+	// Weights are read from the trainer's arena, everything written goes to the shard's buffers
+	void Trainer::forward(TrainerShard& shard, const TrainingSample* samples, int count)
+	{
+		const AnnUtilities::KernelTable& k = AnnUtilities::kernels();
+		AnnUtilities::NetworkArena& buffers = *shard.buffers;
+		const AnnUtilities::ArenaLayer& first = arena.layer(0);
+		const float* columns = arena.at(first.weights);
+		const float* biases = arena.at(first.biases);
+		float* firstOutputs = buffers.at(buffers.layer(0).outputs);
+		for (int b = 0; b < count; ++b)
+		{
+			float* values = firstOutputs + b * first.paddedRows;
+			int* sampleActive = &shard.active[b * ANN_MAX_ACTIVE_INPUTS];
+			shard.activeCounts[b] = activeANNInputs(*samples[b].position, sampleActive, ANN_MAX_ACTIVE_INPUTS);
+			std::copy(biases, biases + first.paddedRows, values);
+			for (int i = 0; i < shard.activeCounts[b]; ++i)
+			{
+				k.axpy(values, columns + sampleActive[i] * first.paddedRows, 1.0f, first.paddedRows);
+			}
+		}
+		k.activate(first.actfunc, firstOutputs, count * first.paddedRows);
+		clearPadding(firstOutputs, first.rows, first.paddedRows, count);
+
+		for (int i = 1; i < arena.layerCount(); ++i)
+		{
+			const AnnUtilities::ArenaLayer& l = arena.layer(i);
+			float* outputs = buffers.at(buffers.layer(i).outputs);
+			k.gemm(arena.at(l.weights), buffers.at(buffers.layer(i - 1).outputs), arena.at(l.biases), outputs, l.paddedRows, l.paddedCols, count);
+			k.activate(l.actfunc, outputs, count * l.paddedRows);
+			clearPadding(outputs, l.rows, l.paddedRows, count);
+		}
+	}
+
+	// Accumulates the gradients of the shard, the forward pass has to have run on the same samples
+	void Trainer::backward(TrainerShard& shard, const TrainingSample* samples, int count)
+	{
+		const AnnUtilities::KernelTable& k = AnnUtilities::kernels();
+		AnnUtilities::NetworkArena& buffers = *shard.buffers;
+		const AnnUtilities::ArenaLayer& output = buffers.outputLayer();
+		float* errors = buffers.at(output.errors);
+		const float* outputs = buffers.at(output.outputs);
+		memset(errors, 0, count * output.paddedRows * sizeof(float));
+		for (int b = 0; b < count; ++b)
+		{
+			errors[b * output.paddedRows] = outputs[b * output.paddedRows] - samples[b].label;
+		}
+		k.derivative(output.actfunc, outputs, errors, count * output.paddedRows);
+
+		for (int i = buffers.layerCount() - 1; i >= 0; --i)
+		{
+			const AnnUtilities::ArenaLayer& l = buffers.layer(i);
+			const float* layerErrors = buffers.at(l.errors);
+			float* biasGradients = buffers.at(l.biasGradients);
+			for (int b = 0; b < count; ++b)
+			{
+				k.axpy(biasGradients, layerErrors + b * l.paddedRows, 1.0f, l.paddedRows);
+			}
+			if (i == 0)
+			{
+				// Only the columns of active inputs get a gradient, the others were multiplied by zero
+				float* gradients = buffers.at(l.weightGradients);
+				for (int b = 0; b < count; ++b)
+				{
+					const int* sampleActive = &shard.active[b * ANN_MAX_ACTIVE_INPUTS];
+					for (int j = 0; j < shard.activeCounts[b]; ++j)
+					{
+						k.axpy(gradients + sampleActive[j] * l.paddedRows, layerErrors + b * l.paddedRows, 1.0f, l.paddedRows);
+					}
+				}
+				break;
+			}
+			const AnnUtilities::ArenaLayer& prev = buffers.layer(i - 1);
+			k.outerAccumulate(buffers.at(l.weightGradients), layerErrors, buffers.at(prev.outputs), l.paddedRows, l.paddedCols, count);
+			k.gemmTransposed(arena.at(arena.layer(i).weights), layerErrors, buffers.at(prev.errors), l.paddedRows, l.paddedCols, count);
+			k.derivative(prev.actfunc, buffers.at(prev.outputs), buffers.at(prev.errors), count * prev.paddedRows);
+		}
+	}
+
+	void Trainer::runShard(TrainerShard& shard, const TrainingSample* samples, int count, float* errors)
+	{
+		shard.loss = 0.0f;
+		if (count <= 0)
+		{
+			return;
+		}
+		forward(shard, samples, count);
+		const AnnUtilities::ArenaLayer& output = shard.buffers->outputLayer();
+		for (int b = 0; b < count; ++b)
+		{
+			float error = shard.buffers->at(output.outputs)[b * output.paddedRows] - samples[b].label;
+			shard.loss += error * error;
+			if (errors != nullptr)
+			{
+				errors[b] = error;
+			}
+		}
+		backward(shard, samples, count);
+	}
+
+	// Sums the gradients of the first used shards into shard 0, pairwise at doubling strides. Every thread handles
+	// its part of each gradient region, the order of the additions does not depend on the part.
+	void Trainer::reduce(int part, int used)
+	{
+		const AnnUtilities::KernelTable& k = AnnUtilities::kernels();
+		for (int i = 0; i < arena.layerCount(); ++i)
+		{
+			for (int region = 0; region < 2; ++region)
+			{
+				size_t size;
+				gradientRegion(arena, i, region, &size);
+				size_t begin = size * part / threads;
+				size_t end = size * (part + 1) / threads;
+				for (int stride = 1; stride < used; stride *= 2)
+				{
+					for (int s = 0; s + stride < used; s += 2 * stride)
+					{
+						float* target = gradientRegion(*shards[s]->buffers, i, region, &size);
+						const float* source = gradientRegion(*shards[s + stride]->buffers, i, region, &size);
+						k.axpy(target + begin, source + begin, 1.0f, (int)(end - begin));
+					}
+				}
+			}
+		}
+	}
+
+	// Applies this thread's part of the reduced gradients and clears the gradients of every shard
+	void Trainer::step(float learningRate, int count, int part)
+	{
+		const AnnUtilities::KernelTable& k = AnnUtilities::kernels();
+		float momentum = arena.networkSettings()._momentum;
+		float scale = -learningRate / count;
+		for (int i = 0; i < arena.layerCount(); ++i)
+		{
+			const AnnUtilities::ArenaLayer& l = arena.layer(i);
+			for (int region = 0; region < 2; ++region)
+			{
+				size_t size;
+				float* gradients = gradientRegion(arena, i, region, &size);
+				size_t begin = size * part / threads;
+				size_t end = size * (part + 1) / threads;
+				float* parameters = arena.at(region == 0 ? l.weights : l.biases);
+				const float* change = gradients;
+				if (momentum > 0.0f)
+				{
+					// The momentum buffers become the step: m = momentum * m + gradient
+					float* velocity = arena.at(region == 0 ? l.weightMomentum : l.biasMomentum);
+					for (size_t j = begin; j < end; ++j)
+					{
+						velocity[j] = momentum * velocity[j] + gradients[j];
+					}
+					change = velocity;
+				}
+				k.axpy(parameters + begin, change + begin, scale, (int)(end - begin));
+				for (const std::unique_ptr<TrainerShard>& shard : shards)
+				{
+					float* shardGradients = gradientRegion(*shard->buffers, i, region, &size);
+					memset(shardGradients + begin, 0, (end - begin) * sizeof(float));
+				}
+			}
+		}
+	}
+
+	// One update from at most batchSize samples. Returns the summed squared error of the batch before the update,
+	// errors receives the error of every sample when it is not null.
+	float Trainer::trainBatch(const TrainingSample* samples, int count, float learningRate, float* errors)
+	{
+		count = std::min(count, batchSize);
+		if (count <= 0)
+		{
+			return 0.0f;
+		}
+		int capacity = shardCapacity();
+		int used = (count + capacity - 1) / capacity;
+		auto shardWork = [&](int i)
+		{
+			int begin = std::min(count, i * capacity);
+			runShard(*shards[i], samples + begin, std::min(count, begin + capacity) - begin, errors != nullptr ? errors + begin : nullptr);
+		};
+		auto updateWork = [&](int part)
+		{
+			reduce(part, used);
+			step(learningRate, count, part);
+		};
+		runParallel(used, shardWork);
+		runParallel(threads, updateWork);
+		float loss = 0.0f;
+		for (int i = 0; i < used; ++i)
+		{
+			loss += shards[i]->loss;
+		}
+		return loss;
+	}
+
+	// Runs the samples in order as consecutive mini-batches. Returns the mean squared error seen while training.
+	float Trainer::train(const std::vector<TrainingSample>& samples, float learningRate)
+	{
+		float loss = 0.0f;
+		for (size_t i = 0; i < samples.size(); i += batchSize)
+		{
+			loss += trainBatch(&samples[i], (int)std::min(samples.size() - i, (size_t)batchSize), learningRate, nullptr);
+		}
+		return samples.empty() ? 0.0f : loss / samples.size();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <iosfwd>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <ANNetwork.h>
+#include "NetworkArena.h"
+
+namespace BoardState
+{
+	struct BoardStateData;
+
+	static const int TRAINING_BATCH_SIZE = 64;
+	// Fewest samples a shard gets while the batch has them, smaller shards cost more in synchronisation than they save
+	static const int TRAINING_MIN_SHARD = 16;
+
+	struct TrainingSample
+	{
+		const BoardStateData* position;
+		float label;
+	};
+
+	// Activations, errors and gradients of one thread's share of a mini-batch
+	struct TrainerShard
+	{
+		AnnUtilities::NetworkArena owned;
+		AnnUtilities::NetworkArena* buffers = nullptr;
+		std::vector<int> active;
+		std::vector<int> activeCounts;
+		float loss = 0.0f;
+	};
+
+	// Trains a copy of the network in an arena, a mini-batch at a time. The first layer is driven by the active inputs
+	// of each sample, both forward and for its weight gradients, the later layers run as matrix-matrix kernels over the
+	// whole batch. Gradients of a batch are summed and applied as one step of learningRate times their mean, with
+	// momentum when the network settings ask for it. Errors follow the library: (output - label) times the derivative.
+	// With more than one thread every batch is split into contiguous shards of at least TRAINING_MIN_SHARD samples,
+	// at most one per thread, and the shard gradients are summed pairwise in a fixed tree order, so a given thread
+	// count always produces the same weights. The helper threads are started by setThreads and sleep between batches.
+	class Trainer
+	{
+	private:
+		AnnUtilities::NetworkArena arena;
+		std::vector<std::unique_ptr<TrainerShard>> shards;
+		int batchSize = TRAINING_BATCH_SIZE;
+		int threads = 1;
+		// Helper i runs part i of the current job, the calling thread runs part 0
+		std::vector<std::thread> helpers;
+		std::mutex poolMutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		std::function<void(int)> job;
+		int jobParts = 0;
+		int pendingParts = 0;
+		unsigned int generation = 0;
+		bool quitting = false;
+
+		int shardCapacity						() const { return std::max((batchSize + threads - 1) / threads, std::min(batchSize, TRAINING_MIN_SHARD)); }
+		void startHelpers						();
+		void stopHelpers						();
+		void help								(int part);
+		void runParallel						(int parts, const std::function<void(int)>& f);
+		void clearPadding						(float* values, int rows, int paddedRows, int count);
+		void forward							(TrainerShard& shard, const TrainingSample* samples, int count);
+		void backward							(TrainerShard& shard, const TrainingSample* samples, int count);
+		void runShard							(TrainerShard& shard, const TrainingSample* samples, int count, float* errors);
+		void reduce								(int part, int used);
+		void step								(float learningRate, int count, int part);
+
+	public:
+		Trainer									() = default;
+		Trainer									(const Trainer&) = delete;
+		Trainer& operator=						(const Trainer&) = delete;
+		~Trainer								();
+
+		void setBatchSize						(int size);
+		void setThreads							(int count);
+		int getBatchSize						() const { return batchSize; }
+		int getThreads							() const { return threads; }
+		const AnnUtilities::NetworkArena& parameters	() const { return arena; }
+		void load								(const AnnUtilities::ANNetwork& network);
+		void store								(AnnUtilities::ANNetwork& network) const;
+		float trainBatch						(const TrainingSample* samples, int count, float learningRate, float* errors);
+		float train								(const std::vector<TrainingSample>& samples, float learningRate);
+		void save								(std::ostream& out) const;
+		void restore							(std::istream& in, const AnnUtilities::ANNSettings& settings);
+	};
+}
\ No newline at end of file
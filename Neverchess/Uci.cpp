@@ -0,0 +1,459 @@
+#include "Uci.h"
+#include "Fen.h"
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+namespace BoardState
+{
+	// Finds the legal move a UCI move string names. The generator only promotes to queen and knight, a rook or bishop
+	// promotion is the queen move with another piece.
+	static bool findMove(const std::vector<MoveData>& legal, const std::string& text, bool turn, MoveData& move)
+	{
+		for (const MoveData& candidate : legal)
+		{
+			std::string written = writeMove(candidate, turn);
+			if (written == text)
+			{
+				move = candidate;
+				return true;
+			}
+			if (text.size() == 5 && (text[4] == 'r' || text[4] == 'b') && written.size() == 5 && written[4] == 'q'
+				&& written.compare(0, 4, text, 0, 4) == 0)
+			{
+				move = candidate;
+				if (text[4] == 'r')
+				{
+					move.upgrade = turn ? PieceCode::B_ROOK : PieceCode::W_ROOK;
+				}
+				else
+				{
+					move.upgrade = turn ? PieceCode::B_BISHOP : PieceCode::W_BISHOP;
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	UciEngine::~UciEngine()
+	{
+		stopSearch();
+	}
+
+	void UciEngine::init(AnnUtilities::ANNetwork& network, int threads)
+	{
+		threadCount = std::min(std::max(1, threads), UCI_MAX_THREADS);
+		weights = std::make_shared<const AnnUtilities::InferenceNetwork>(network, false);
+		resizeWorkers();
+		workers[0]->resetBoardStateData(position);
+	}
+
+	void UciEngine::resizeWorkers()
+	{
+		if (!useQuantized)
+		{
+			quantized.reset();
+		}
+		else if (!quantized)
+		{
+			// Networks quantize can not represent are searched in float
+			try
+			{
+				quantized.reset(new QuantizedNetwork());
+				quantized->quantize(*weights);
+			}
+			catch (const std::exception& e)
+			{
+				quantized.reset();
+				send(std::string("info string ") + e.what() + ", searching with the float network");
+			}
+		}
+		workers.resize(threadCount);
+		for (std::unique_ptr<BoardManager>& worker : workers)
+		{
+			if (!worker)
+			{
+				worker.reset(new BoardManager());
+				worker->calculateZobristValues();
+				worker->setVerbose(false);
+			}
+			worker->setHashSize(hash);
+			worker->shareNetwork(identity, weights);
+			worker->setQuantizedNetwork(quantized.get());
+		}
+	}
+
+	void UciEngine::loop(std::istream& in, std::ostream& output)
+	{
+		out = &output;
+		std::string line;
+		while (std::getline(in, line))
+		{
+			std::istringstream command(line);
+			std::string token;
+			if (!(command >> token))
+			{
+				continue;
+			}
+			if (token == "uci")
+			{
+				send("id name Neverchess");
+				send("id author ilkp");
+				send("option name Hash type spin default " + std::to_string(UCI_DEFAULT_HASH) + " min 1 max " + std::to_string(UCI_MAX_HASH));
+				send("option name Threads type spin default " + std::to_string(threadCount) + " min 1 max " + std::to_string(UCI_MAX_THREADS));
+				send("option name EvalFile type string default <empty>");
+				send("option name Quantized type check default false");
+				send("option name SearchMode type combo default AlphaBeta var AlphaBeta var MCTS");
+				send("option name Playouts type spin default " + std::to_string(UCI_DEFAULT_PLAYOUTS) + " min 1 max " + std::to_string(UCI_MAX_PLAYOUTS));
+				send("uciok");
+			}
+			else if (token == "isready")
+			{
+				send("readyok");
+			}
+			else if (token == "setoption")
+			{
+				// setoption name <name> [value <value>], both may contain spaces
+				std::string name;
+				std::string value;
+				std::string* field = nullptr;
+				while (command >> token)
+				{
+					if (token == "name" || token == "value")
+					{
+						field = token == "name" ? &name : &value;
+					}
+					else if (field != nullptr)
+					{
+						*field += (field->empty() ? "" : " ") + token;
+					}
+				}
+				stopSearch();
+				setOption(name, value);
+			}
+			else if (token == "ucinewgame")
+			{
+				stopSearch();
+				workers[0]->resetBoardStateData(position);
+			}
+			else if (token == "position")
+			{
+				stopSearch();
+				setPosition(command);
+			}
+			else if (token == "go")
+			{
+				stopSearch();
+				Go go = parseGo(command);
+				stop = false;
+				searchThread = std::thread(&UciEngine::search, this, go);
+			}
+			else if (token == "stop")
+			{
+				stopSearch();
+			}
+			else if (token == "quit")
+			{
+				break;
+			}
+		}
+		stopSearch();
+	}
+
+	void UciEngine::setOption(const std::string& name, const std::string& value)
+	{
+		if (name == "Hash")
+		{
+			hash = std::min(std::max(1, atoi(value.c_str())), UCI_MAX_HASH);
+			resizeWorkers();
+		}
+		else if (name == "Threads")
+		{
+			threadCount = std::min(std::max(1, atoi(value.c_str())), UCI_MAX_THREADS);
+			resizeWorkers();
+		}
+		else if (name == "EvalFile")
+		{
+			if (value.empty() || value == "<empty>")
+			{
+				return;
+			}
+			try
+			{
+				weights = std::make_shared<const AnnUtilities::InferenceNetwork>(value);
+				quantized.reset();
+				resizeWorkers();
+			}
+			catch (const std::exception& e)
+			{
+				send(std::string("info string ") + e.what());
+			}
+		}
+		else if (name == "SearchMode")
+		{
+			searchMode = value == "MCTS" ? SearchMode::MCTS : SearchMode::ALPHA_BETA;
+		}
+		else if (name == "Playouts")
+		{
+			playouts = std::min(std::max(1, atoi(value.c_str())), UCI_MAX_PLAYOUTS);
+		}
+		else if (name == "Quantized")
+		{
+			useQuantized = value == "true";
+			resizeWorkers();
+		}
+		else
+		{
+			send("info string unknown option " + name);
+		}
+	}
+
+	// position startpos|fen <fen> [moves <move>...], a move that is not legal ends the list
+	void UciEngine::setPosition(std::istream& command)
+	{
+		std::string token;
+		command >> token;
+		BoardStateData parsed;
+		if (token == "fen")
+		{
+			std::string fen;
+			while (command >> token && token != "moves")
+			{
+				fen += (fen.empty() ? "" : " ") + token;
+			}
+			if (!parseFen(fen, parsed))
+			{
+				send("info string invalid fen " + fen);
+				return;
+			}
+		}
+		else
+		{
+			workers[0]->resetBoardStateData(parsed);
+			command >> token;
+		}
+		while (command >> token)
+		{
+			MoveData move;
+			if (!findMove(workers[0]->legalMoves(parsed), token, parsed._turn, move))
+			{
+				send("info string illegal move " + token);
+				break;
+			}
+			applyMove(parsed, move);
+		}
+		position.copy(parsed);
+	}
+
+	UciEngine::Go UciEngine::parseGo(std::istream& command)
+	{
+		Go go;
+		int time[2] = { 0, 0 };
+		int increment[2] = { 0, 0 };
+		int movesToGo = 0;
+		int moveTime = 0;
+		std::vector<MoveData> legal = workers[0]->legalMoves(position);
+		std::string token;
+		while (command >> token)
+		{
+			if (token == "depth") command >> go.limits.depth;
+			else if (token == "nodes") command >> go.limits.nodes;
+			else if (token == "movetime") command >> moveTime;
+			else if (token == "wtime") command >> time[0];
+			else if (token == "btime") command >> time[1];
+			else if (token == "winc") command >> increment[0];
+			else if (token == "binc") command >> increment[1];
+			else if (token == "movestogo") command >> movesToGo;
+			else if (token == "infinite") go.infinite = true;
+			else if (token == "searchmoves")
+			{
+				// The moves run to the end of the line or to the next keyword, which then is not a move
+				MoveData move;
+				while (command >> token && findMove(legal, token, position._turn, move))
+				{
+					go.limits.rootMoves.push_back(move);
+				}
+				if (command)
+				{
+					command.seekg(-(std::streamoff)token.size(), std::ios_base::cur);
+				}
+			}
+		}
+
+		if (moveTime > 0)
+		{
+			go.limits.milliseconds = moveTime;
+		}
+		else if (time[position._turn] > 0 && !go.infinite)
+		{
+			// An even share of the remaining time plus most of the increment, never closer to the flag than the margin
+			int remaining = time[position._turn];
+			int budget = remaining / (movesToGo > 0 ? movesToGo : UCI_MOVES_TO_GO) + increment[position._turn] * 3 / 4;
+			go.limits.milliseconds = std::max(1, std::min(budget, remaining - UCI_TIME_MARGIN));
+		}
+		return go;
+	}
+
+	void UciEngine::search(Go go)
+	{
+		std::vector<MoveData> roots = go.limits.rootMoves.empty() ? workers[0]->legalMoves(position) : go.limits.rootMoves;
+		int threads = std::min((int)roots.size(), threadCount);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			results.assign(threads, std::vector<SearchResult>());
+			completeDepth = 0;
+			best = SearchResult();
+		}
+		if (threads > 0 && searchMode == SearchMode::MCTS)
+		{
+			searchMcts(go);
+		}
+		else if (threads > 0)
+		{
+			// Every thread searches every threads-th root move
+			std::vector<SearchLimits> limits(threads, go.limits);
+			for (int t = 0; t < threads; ++t)
+			{
+				limits[t].rootMoves.clear();
+				for (unsigned int i = t; i < roots.size(); i += threads)
+				{
+					limits[t].rootMoves.push_back(roots[i]);
+				}
+				limits[t].nodes = go.limits.nodes > 0 ? std::max(1LL, go.limits.nodes / threads) : 0;
+				limits[t].stop = &stop;
+				limits[t].report = [this, t](const SearchResult& result) { report(t, result); };
+			}
+			auto work = [&](int t)
+			{
+				BoardStateData root;
+				root.copy(position);
+				workers[t]->iterativeSearch(root, identity, limits[t]);
+			};
+			std::vector<std::thread> helpers;
+			for (int t = 1; t < threads; ++t)
+			{
+				helpers.push_back(std::thread(work, t));
+			}
+			work(0);
+			for (std::thread& helper : helpers)
+			{
+				helper.join();
+			}
+		}
+
+		// An infinite search must not answer before the GUI says stop
+		while (go.infinite && !stop)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		std::string bestMove = "bestmove " + writeMove(best.evaluation.move, position._turn);
+		if (best.pv.size() > 1)
+		{
+			bestMove += " ponder " + writeMove(best.pv[1], !position._turn);
+		}
+		send(bestMove);
+	}
+
+	// MCTS has no iterations, the search is reported once when it ends. It ends after its playouts, at the deadline of
+	// the go command or on stop, whichever comes first.
+	void UciEngine::searchMcts(const Go& go)
+	{
+		SearchLimits limits = go.limits;
+		limits.nodes = go.limits.nodes > 0 ? std::min(go.limits.nodes, (long long)UCI_MAX_PLAYOUTS) : playouts;
+		limits.stop = &stop;
+		BoardStateData root;
+		root.copy(position);
+		workers[0]->setSearchThreads(threadCount);
+		SearchResult result = workers[0]->mcts(root, identity, limits);
+		std::lock_guard<std::mutex> lock(mutex);
+		best.evaluation = result.evaluation;
+		best.nodes = result.nodes;
+		best.pv = result.pv;
+		send("info score " + score(result.evaluation.evaluatedValue, 1) + " nodes " + std::to_string(result.nodes) + " nps "
+			+ std::to_string(result.nodes * 1000 / std::max(1LL, (long long)result.milliseconds)) + " time "
+			+ std::to_string((long long)result.milliseconds) + " pv " + writeMove(result.evaluation.move, position._turn));
+	}
+
+	// A thread that found a mate stops deepening, its result stands for every deeper iteration
+	bool UciEngine::depthComplete(int depth) const
+	{
+		for (const std::vector<SearchResult>& thread : results)
+		{
+			if ((int)thread.size() < depth && (thread.empty() || fabs(thread.back().evaluation.evaluatedValue) < 1000.0f))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Collects the iterations of the search threads and sends an info line for every depth all of them finished
+	void UciEngine::report(int thread, const SearchResult& result)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		results[thread].push_back(result);
+		bool turn = position._turn;
+		while (depthComplete(completeDepth + 1) && std::any_of(results.begin(), results.end(),
+			[this](const std::vector<SearchResult>& searched) { return (int)searched.size() > completeDepth; }))
+		{
+			++completeDepth;
+			long long nodes = 0;
+			double milliseconds = 0.0;
+			for (const std::vector<SearchResult>& searched : results)
+			{
+				const SearchResult& candidate = searched[std::min((int)searched.size(), completeDepth) - 1];
+				float value = candidate.evaluation.evaluatedValue;
+				// Black maximises the network output, white minimises it
+				if (nodes == 0 || (turn ? value > best.evaluation.evaluatedValue : value < best.evaluation.evaluatedValue))
+				{
+					best = candidate;
+				}
+				nodes += candidate.nodes;
+				milliseconds = std::max(milliseconds, candidate.milliseconds);
+			}
+			std::string info = "info depth " + std::to_string(completeDepth) + " score " + score(best.evaluation.evaluatedValue, (int)best.pv.size())
+				+ " nodes " + std::to_string(nodes) + " nps " + std::to_string(nodes * 1000 / std::max(1LL, (long long)milliseconds))
+				+ " time " + std::to_string((long long)milliseconds) + " pv";
+			bool side = turn;
+			for (const MoveData& move : best.pv)
+			{
+				info += " " + writeMove(move, side);
+				side = !side;
+			}
+			send(info);
+		}
+	}
+
+	// Ends a running search, its bestmove is sent before this returns
+	void UciEngine::stopSearch()
+	{
+		if (searchThread.joinable())
+		{
+			stop = true;
+			searchThread.join();
+		}
+	}
+
+	void UciEngine::send(const std::string& line)
+	{
+		std::lock_guard<std::mutex> lock(outputMutex);
+		*out << line << std::endl;
+	}
+
+	// value is the probability that black wins, or +-1000 for a mate that the pv leads to
+	std::string UciEngine::score(float value, int pvLength) const
+	{
+		bool turn = position._turn;
+		if (fabs(value) >= 1000.0f)
+		{
+			bool winning = (value > 0.0f) == turn;
+			return winning ? "mate " + std::to_string((pvLength + 1) / 2) : "mate -" + std::to_string(pvLength / 2);
+		}
+		float probability = std::min(std::max(turn ? value : 1.0f - value, 0.001f), 0.999f);
+		return "cp " + std::to_string((int)std::lround(400.0 * log10(probability / (1.0 - probability))));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <iostream>
+#include <ANNetwork.h>
+#include "BoardState.h"
+#include "InferenceNetwork.h"
+
+namespace BoardState
+{
+	// Transposition table size of every search thread in megabytes, and the range the Hash option allows
+	static const int UCI_DEFAULT_HASH = 64;
+	static const int UCI_MAX_HASH = 4096;
+	static const int UCI_MAX_THREADS = 256;
+	// Playouts of an MCTS search when go does not limit the nodes
+	static const int UCI_DEFAULT_PLAYOUTS = 800;
+	static const int UCI_MAX_PLAYOUTS = 10000000;
+	// Moves still to play when the GUI does not say, and the time kept back for the GUI and the operating system
+	static const int UCI_MOVES_TO_GO = 30;
+	static const int UCI_TIME_MARGIN = 50;
+
+	// Speaks the Universal Chess Interface on a pair of streams, so the engine can play in GUIs and tournament managers.
+	// A go command starts a search on its own thread and the loop keeps reading, so stop and quit are answered while it
+	// runs. With several threads the root moves are dealt out between them and every thread searches its share with
+	// iterative deepening, a depth is reported once all threads finished it or found a mate. With the SearchMode option
+	// set to MCTS the first worker runs one MCTS search on all threads instead, for Playouts playouts or go nodes,
+	// until the time of the go command is up or stop. Scores are in centipawns, converted from the win probability of
+	// the side to move with the usual logistic 400 scale.
+	class UciEngine
+	{
+	private:
+		struct Go
+		{
+			SearchLimits limits;
+			bool infinite = false;
+		};
+
+		std::vector<std::unique_ptr<BoardManager>> workers;
+		// Only identifies the weights to the workers' accumulators, its layers are never read
+		AnnUtilities::ANNetwork identity;
+		std::shared_ptr<const AnnUtilities::InferenceNetwork> weights;
+		// int8/int16 copy of weights the workers evaluate with while the Quantized option is on, made when it is needed
+		bool useQuantized = false;
+		std::unique_ptr<QuantizedNetwork> quantized;
+		int hash = UCI_DEFAULT_HASH;
+		int threadCount = 1;
+		SearchMode searchMode = SearchMode::ALPHA_BETA;
+		int playouts = UCI_DEFAULT_PLAYOUTS;
+		BoardStateData position;
+		std::thread searchThread;
+		std::atomic<bool> stop{ false };
+		std::mutex mutex;
+		std::mutex outputMutex;
+		std::ostream* out = nullptr;
+		// Every finished iteration of every search thread, and the deepest depth all of them have finished
+		std::vector<std::vector<SearchResult>> results;
+		int completeDepth = 0;
+		SearchResult best;
+
+		void resizeWorkers						();
+		void setOption							(const std::string& name, const std::string& value);
+		void setPosition						(std::istream& command);
+		Go parseGo								(std::istream& command);
+		void search								(Go go);
+		void searchMcts							(const Go& go);
+		void report								(int thread, const SearchResult& result);
+		bool depthComplete						(int depth) const;
+		void stopSearch							();
+		void send								(const std::string& line);
+		std::string score						(float value, int pvLength) const;
+
+	public:
+		~UciEngine								();
+		void init								(AnnUtilities::ANNetwork& network, int threads);
+		void loop								(std::istream& in, std::ostream& output);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include <iostream>
+#include <string>
+#include "BoardState.h"
+#include "Fen.h"
+
+static int failures = 0;
+
+static void check(bool passed, const std::string& what)
+{
+	if (!passed)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		++failures;
+	}
+}
+
+// Positions that write back to the same text, the fullmove number is always written as 1
+static const char* ROUND_TRIPS[] =
+{
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 1",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 b - - 12 1",
+	"r3k2r/8/8/8/8/8/8/4K2R w Kq - 3 1"
+};
+
+// Text that is not a position, or a position the engine can not search
+static const char* REJECTED[] =
+{
+	"",
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP w KQkq - 0 1",
+	"rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1",
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkx - 0 1",
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e4 0 1",
+	// No king, two kings
+	"8/8/8/8/8/8/8/4K3 w - - 0 1",
+	"4k3/8/8/8/8/8/8/3KK3 w - - 0 1",
+	// More than 16 pieces a side
+	"4k3/pppppppp/pppppppp/pppppppp/pppppppp/pppppppp/8/4K3 w - - 0 1",
+	// Pawns on the last and the first rank
+	"4k2P/8/8/8/8/8/8/4K3 w - - 0 1",
+	"4k3/8/8/8/8/8/8/p3K3 b - - 0 1",
+	// The side to move could take the king
+	"4k3/8/8/8/8/8/8/4K2r b - - 0 1",
+	"4k3/3P4/8/8/8/8/8/4K3 w - - 0 1",
+	"4k3/8/8/8/8/5n2/8/4K3 b - - 0 1",
+	"8/8/8/8/8/8/8/3kK3 w - - 0 1"
+};
+
+struct SanCase
+{
+	const char* fen;
+	const char* san;
+	// The move in UCI notation, empty when the SAN has to be refused
+	const char* move;
+};
+
+static const SanCase SAN_CASES[] =
+{
+	{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "e4", "e2e4" },
+	{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "Nf3", "g1f3" },
+	{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "Ke2", "" },
+	{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", "e5", "" },
+	{ "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", "O-O", "e1g1" },
+	{ "r3k2r/8/8/8/8/8/8/R3K2R b KQkq - 0 1", "O-O-O", "e8c8" },
+	{ "rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 1", "exd6", "e5d6" },
+	{ "4k3/1P6/8/8/8/8/8/4K3 w - - 0 1", "b8=Q+", "b7b8q" },
+	// Both knights reach d2, the file tells them apart
+	{ "4k3/8/8/8/8/8/8/1N2KN2 w - - 0 1", "Nbd2", "b1d2" },
+	{ "4k3/8/8/8/8/8/8/1N2KN2 w - - 0 1", "Nfd2", "f1d2" }
+};
+
+int main()
+{
+	for (const char* fen : ROUND_TRIPS)
+	{
+		BoardState::BoardStateData board;
+		check(BoardState::parseFen(fen, board), std::string("parse ") + fen);
+		check(BoardState::writeFen(board) == fen, std::string("write ") + fen + " gave " + BoardState::writeFen(board));
+	}
+	for (const char* fen : REJECTED)
+	{
+		BoardState::BoardStateData board;
+		check(!BoardState::parseFen(fen, board), std::string("reject ") + fen);
+	}
+
+	// Legal in check for the side to move, and an EPD line without move counters
+	BoardState::BoardStateData board;
+	check(BoardState::parseFen("4k3/8/8/8/8/8/8/4K2r w - - 0 1", board), "side to move in check");
+	check(BoardState::parseFen("4k3/8/8/8/8/8/8/4K3 w - - bm Kd2;", board) && board._halfmoveClock == 0, "EPD line");
+
+	BoardState::BoardManager manager;
+	for (const SanCase& test : SAN_CASES)
+	{
+		BoardState::BoardStateData position;
+		MoveData move;
+		BoardState::parseFen(test.fen, position);
+		bool parsed = manager.parseSan(position, test.san, move);
+		std::string expected = test.move;
+		check(expected.empty() ? !parsed : parsed && BoardState::writeMove(move, position._turn) == expected,
+			std::string("SAN ") + test.san + " in " + test.fen);
+	}
+
+	// A board no FEN would give still must not write more inputs than the caller has room for
+	BoardState::BoardStateData crowded;
+	for (PieceCode& piece : crowded._pieces)
+	{
+		piece = PieceCode::B_ROOK;
+	}
+	int active[BoardState::ANN_MAX_ACTIVE_INPUTS + 1];
+	active[BoardState::ANN_MAX_ACTIVE_INPUTS] = -1;
+	check(BoardState::activeANNInputs(crowded, active, BoardState::ANN_MAX_ACTIVE_INPUTS) == BoardState::ANN_MAX_ACTIVE_INPUTS
+		&& active[BoardState::ANN_MAX_ACTIVE_INPUTS] == -1, "active inputs stay within capacity");
+
+	std::cout << (failures == 0 ? "All FEN and SAN tests passed" : "FEN and SAN tests failed") << std::endl;
+	return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
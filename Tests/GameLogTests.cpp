@@ -0,0 +1,213 @@
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include "BoardState.h"
+#include "Fen.h"
+#include "GameLog.h"
+
+static const char* LOG_FILE = "GameLogTests.games";
+static const int GAMES = 24;
+static const int MAX_PLIES = 120;
+
+static int failures = 0;
+
+static void check(bool passed, const std::string& what)
+{
+	if (!passed)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		++failures;
+	}
+}
+
+// Random legal games from the start position and a few FENs, so castling, en passant and promotions are logged
+static std::vector<BoardState::PlayedGame> randomGames(BoardState::BoardManager& manager)
+{
+	const char* starts[] =
+	{
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 1",
+		"4k3/1P6/8/8/8/8/6p1/4K3 w - - 0 1"
+	};
+	std::mt19937 random(1);
+	std::vector<BoardState::PlayedGame> games;
+	for (int g = 0; g < GAMES; ++g)
+	{
+		BoardState::PlayedGame game;
+		BoardState::parseFen(starts[g % 4], game.start);
+		BoardState::BoardStateData boardStateData;
+		boardStateData.copy(game.start);
+		int plies = (int)(random() % MAX_PLIES);
+		for (int ply = 0; ply < plies; ++ply)
+		{
+			std::vector<MoveData> legal = manager.legalMoves(boardStateData);
+			if (legal.empty())
+			{
+				break;
+			}
+			game.moves.push_back(legal[random() % legal.size()]);
+			game.values.push_back((float)(random() % 1000) / 1000.0f);
+			BoardState::applyMove(boardStateData, game.moves.back());
+		}
+		game.whiteWin = g % 3 == 0;
+		game.blackWin = g % 3 == 1;
+		game.ending = (BoardState::GameEnd)(g % 3);
+		games.push_back(game);
+	}
+	return games;
+}
+
+static bool sameGame(const BoardState::PlayedGame& a, const BoardState::PlayedGame& b)
+{
+	bool same = BoardState::writeFen(a.start) == BoardState::writeFen(b.start) && a.moves.size() == b.moves.size()
+		&& a.values == b.values && a.whiteWin == b.whiteWin && a.blackWin == b.blackWin && a.ending == b.ending;
+	for (size_t i = 0; same && i < a.moves.size(); ++i)
+	{
+		const MoveData& x = a.moves[i];
+		const MoveData& y = b.moves[i];
+		same = BoardState::sameMove(x, y) && x.shortCastle == y.shortCastle && x.longCastle == y.longCastle
+			&& x.doublePawnMove == y.doublePawnMove && x.enPassant == y.enPassant;
+	}
+	return same;
+}
+
+// Keeps the first bytes of a file
+static void cutFile(const std::string& fileName, size_t bytes)
+{
+	std::vector<char> data;
+	{
+		std::ifstream in(fileName, std::ios_base::binary);
+		data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	std::ofstream out(fileName, std::ios_base::binary | std::ios_base::trunc);
+	out.write(data.data(), std::min(bytes, data.size()));
+}
+
+static size_t fileBytes(const std::string& fileName)
+{
+	std::ifstream in(fileName, std::ios_base::binary | std::ios_base::ate);
+	return in ? (size_t)in.tellg() : 0;
+}
+
+// Writes games, reads them back from the mapped log and checks what a crash in the middle of a write leaves readable
+int main()
+{
+	std::string index = std::string(LOG_FILE) + ".idx";
+	std::remove(LOG_FILE);
+	std::remove(index.c_str());
+
+	BoardState::BoardManager manager;
+	std::vector<BoardState::PlayedGame> games = randomGames(manager);
+	{
+		BoardState::GameLogWriter writer;
+		writer.open(LOG_FILE);
+		for (int g = 0; g < GAMES - 1; ++g)
+		{
+			writer.write(games[g]);
+		}
+	}
+	// A second run appends to the log of the first
+	{
+		BoardState::GameLogWriter writer;
+		writer.open(LOG_FILE);
+		writer.write(games[GAMES - 1]);
+	}
+
+	BoardState::GameLogReader reader;
+	reader.open(LOG_FILE);
+	check(reader.games() == GAMES, "games in the log");
+	for (int g = 0; g < reader.games() && g < GAMES; ++g)
+	{
+		check(sameGame(reader.game(g), games[g]), "game " + std::to_string(g) + " read back");
+	}
+
+	// Every position the replayed moves reach, in the order of the games
+	std::vector<std::string> expected;
+	for (const BoardState::PlayedGame& game : games)
+	{
+		BoardState::BoardStateData boardStateData;
+		boardStateData.copy(game.start);
+		for (const MoveData& move : game.moves)
+		{
+			BoardState::applyMove(boardStateData, move);
+			expected.push_back(BoardState::writeFen(boardStateData));
+		}
+	}
+	size_t position = 0;
+	bool inOrder = true;
+	reader.forEachPosition([&](const BoardState::BoardStateData& boardStateData, float value, int game, int ply)
+	{
+		inOrder = inOrder && position < expected.size() && BoardState::writeFen(boardStateData) == expected[position]
+			&& value == games[game].values[ply];
+		++position;
+	});
+	check(inOrder && position == expected.size(), "forEachPosition replays every position");
+	reader.close();
+
+	// A record cut short ends the log, and without an index the records are found by walking them
+	cutFile(LOG_FILE, fileBytes(LOG_FILE) - 1);
+	reader.open(LOG_FILE);
+	check(reader.games() == GAMES - 1, "a cut record is dropped");
+	reader.close();
+	std::remove(index.c_str());
+	reader.open(LOG_FILE);
+	check(reader.games() == GAMES - 1, "games found without an index");
+	for (int g = 0; g < reader.games(); ++g)
+	{
+		check(sameGame(reader.game(g), games[g]), "game " + std::to_string(g) + " read without an index");
+	}
+	reader.close();
+
+	cutFile(LOG_FILE, 4);
+	bool refused = false;
+	try
+	{
+		reader.open(LOG_FILE);
+	}
+	catch (const std::exception&)
+	{
+		refused = true;
+	}
+	check(refused, "a file without a log header is refused");
+
+	// A resumed run keeps the games of its checkpoint and writes after them, a cut record goes as well
+	std::remove(LOG_FILE);
+	{
+		BoardState::GameLogWriter writer;
+		writer.open(LOG_FILE);
+		for (int g = 0; g < GAMES - 1; ++g)
+		{
+			writer.write(games[g]);
+		}
+	}
+	cutFile(LOG_FILE, fileBytes(LOG_FILE) - 1);
+	{
+		BoardState::GameLogWriter writer;
+		writer.open(LOG_FILE, GAMES);
+		writer.write(games[GAMES - 1]);
+	}
+	reader.open(LOG_FILE);
+	check(reader.games() == GAMES - 1 && sameGame(reader.game(GAMES - 2), games[GAMES - 1]), "a cut record is dropped on resume");
+	reader.close();
+	{
+		BoardState::GameLogWriter writer;
+		writer.open(LOG_FILE, GAMES / 2);
+		writer.write(games[0]);
+	}
+	reader.open(LOG_FILE);
+	check(reader.games() == GAMES / 2 + 1 && sameGame(reader.game(GAMES / 2 - 1), games[GAMES / 2 - 1])
+		&& sameGame(reader.game(GAMES / 2), games[0]), "games after the checkpoint are dropped on resume");
+	reader.close();
+
+	std::remove(LOG_FILE);
+	std::remove(index.c_str());
+	std::cout << (failures == 0 ? "All game log tests passed" : "Game log tests failed") << std::endl;
+	return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
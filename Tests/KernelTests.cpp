@@ -0,0 +1,26 @@
+#include <iostream>
+#include "Kernels.h"
+
+// Checks every vectorized kernel table the CPU can run against the scalar kernels. Dispatch quietly falls back to a
+// lower level when a table drifts past KERNEL_TOLERANCE, this makes the drift fail the build instead.
+int main()
+{
+	const AnnUtilities::KernelTable& scalar = *AnnUtilities::kernelTable(AnnUtilities::SimdLevel::SCALAR);
+	const AnnUtilities::SimdLevel levels[] = { AnnUtilities::SimdLevel::SSE42, AnnUtilities::SimdLevel::AVX2, AnnUtilities::SimdLevel::AVX512 };
+	int failures = 0;
+	for (AnnUtilities::SimdLevel level : levels)
+	{
+		const AnnUtilities::KernelTable* table = AnnUtilities::kernelTable(level);
+		if (table == nullptr || !AnnUtilities::cpuSupports(level))
+		{
+			std::cout << AnnUtilities::simdLevelName(level) << ": not supported, skipped" << std::endl;
+			continue;
+		}
+		float difference = AnnUtilities::compareKernels(scalar, *table);
+		bool passed = difference <= AnnUtilities::KERNEL_TOLERANCE;
+		std::cout << AnnUtilities::simdLevelName(level) << ": largest relative difference " << difference
+			<< (passed ? ", passed" : ", FAILED") << std::endl;
+		failures += !passed;
+	}
+	return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
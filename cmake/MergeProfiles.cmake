@@ -0,0 +1,9 @@
+# Merges the raw Clang profiles of a training run into the neverchess.profdata the USE build reads
+file(GLOB raw_profiles "${PGO_DIR}/*.profraw")
+if(NOT raw_profiles)
+	message(FATAL_ERROR "No profiles in ${PGO_DIR}, did the instrumented build run?")
+endif()
+execute_process(COMMAND ${LLVM_PROFDATA} merge -output=${PGO_DIR}/neverchess.profdata ${raw_profiles} RESULT_VARIABLE merged)
+if(NOT merged EQUAL 0)
+	message(FATAL_ERROR "llvm-profdata failed")
+endif()